@@ -4,6 +4,7 @@
 #include "token.h"
 #include "utils.h"
 #include "symtable.h"
+#include "vm.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,6 +35,7 @@ void ast_freenode(ast_node* node){
         case AST_AND: case AST_OR: case AST_XOR: case AST_NEQUAL:
         case AST_EQUAL: case AST_EGREATER: case AST_GREATER: case AST_ELESS:
         case AST_LESS: case AST_ASSIGN: case AST_PROPERTY:
+        case AST_ADD_ASSIGN: case AST_SUB_ASSIGN: case AST_MUL_ASSIGN: case AST_DIV_ASSIGN:
             ast_freenode(((struct ast_binary*)node->data.ptr)->left);
             ast_freenode(((struct ast_binary*)node->data.ptr)->right);
             free(node->data.ptr);
@@ -47,6 +49,9 @@ void ast_freenode(ast_node* node){
             free(ptr);
             break;
         }
+        case AST_INTERP:
+            freeargs(node->data.ptr);
+            break;
         default:
             eprintf("ast_freenode() ");
             UNDEFINED_AST_NODE_TYPE(node);
@@ -126,6 +131,10 @@ static void ast_debug_node(const ast_node* node){
             break;
         }
         case AST_ASSIGN: DEBUG_BINARY(=); break;
+        case AST_ADD_ASSIGN: DEBUG_BINARY(+=); break;
+        case AST_SUB_ASSIGN: DEBUG_BINARY(-=); break;
+        case AST_MUL_ASSIGN: DEBUG_BINARY(*=); break;
+        case AST_DIV_ASSIGN: DEBUG_BINARY(/=); break;
         case AST_NEQUAL: DEBUG_BINARY(!=); break;
         case AST_EQUAL: DEBUG_BINARY(==); break;
         case AST_EGREATER: DEBUG_BINARY(>=); break;
@@ -144,6 +153,12 @@ static void ast_debug_node(const ast_node* node){
             putchar(')');
             break;
         }
+        case AST_INTERP:{
+            printf("interp(");
+            ast_debug_args(node->data.ptr);
+            putchar(')');
+            break;
+        }
         case AST_PROPERTY:{
             putchar('(');
             ast_debug_node(((struct ast_binary*)node->data.ptr)->left);
@@ -301,6 +316,16 @@ value_t ast_eval(ast_node* root){
             symtable_set(AS_OBJIDENTIFIER(a), b);
             return b;
         }
+        case AST_ADD_ASSIGN: case AST_SUB_ASSIGN: case AST_MUL_ASSIGN: case AST_DIV_ASSIGN:{
+            struct ast_binary* bin = root->data.ptr;
+            if(bin->left->type != AST_IDENT)
+                compile_error_printf("Left value is not assignable\n");
+            //evaluate the arithmetic operation with the same operands
+            ast_node op_node = {.type = AST_COMPOUND_OP(root->type), .data = root->data};
+            value_t val = ast_eval(&op_node);
+            symtable_set(AS_OBJIDENTIFIER(bin->left->data.val), val);
+            return val;
+        }
         case AST_POSTINCR:
             POST_OP(++);
         case AST_PREFINCR:
@@ -309,8 +334,57 @@ value_t ast_eval(ast_node* root){
             POST_OP(--);
         case AST_PREFDECR:
             PREF_OP(--);
-        case AST_CALL:
-            compile_error_printf("Global variables must have constant value\n");
+        case AST_CALL:{
+            //only pure functions may be evaluated
+            struct ast_call_info* info = root->data.ptr;
+            value_t func;
+            if(!symtable_get(info->id, &func))
+                compile_error_printf("Global variables must have constant value\n");
+            //the body may be skipped by the lazy parser
+            if(IS_OBJFUNCTION(func))
+                vm_compile_for_eval(AS_OBJFUNCTION(func));
+            bool is_native = IS_OBJNATFUNCTION(func);
+            if(is_native ? !(AS_OBJNATFUNCTION(func)->flags & NATIVE_PURE) || (AS_OBJNATFUNCTION(func)->flags & NATIVE_ALLOCATES)
+                         : !IS_OBJFUNCTION(func) || !AS_OBJFUNCTION(func)->is_pure)
+                compile_error_printf("Global variables must have constant value\n");
+            value_t argv[ARGUMENTS_COUNT];
+            int argc = 0;
+            for(struct ast_call_arg* p = info->args; p; p = p->next)
+                argc++;
+            int expected = AS_OBJFUNCBASE(func)->argc;
+            if(expected != NATIVE_VARIADIC && argc != expected)
+                compile_error_printf("Expected %d arguments in '%s' function call, found %d\n",
+                expected, info->id->str, argc);
+            //arguments are stored in reverse order
+            int i = argc;
+            for(struct ast_call_arg* p = info->args; p; p = p->next)
+                argv[--i] = ast_eval(p->arg);
+            value_t result;
+            bool is_ok = is_native ? vm_eval_native(AS_OBJNATFUNCTION(func), argc, argv, &result)
+                                   : vm_eval_call(AS_OBJFUNCTION(func), argc, argv, &result);
+            if(!is_ok || IS_NONE(result) || IS_OBJINSTANCE(result))
+                compile_error_printf("Failed to evaluate '%s' call at compile time\n", info->id->str);
+            return result;
+        }
+        case AST_INTERP:{
+            value_t parts[ARGUMENTS_COUNT];
+            int count = 0;
+            for(struct ast_call_arg* p = root->data.ptr; p; p = p->next){
+                if(count == ARGUMENTS_COUNT)
+                    compile_error_printf("Too many parts in the interpolated string\n");
+                obj_string_t* str = value_to_objstring(ast_eval(p->arg));
+                if(str == NULL)
+                    compile_error_printf("Cannot convert value to string\n");
+                parts[count++] = VALUE_OBJ(str);
+            }
+            //parts are stored in reverse order
+            for(int i = 0; i < count / 2; i++){
+                value_t temp = parts[i];
+                parts[i] = parts[count - 1 - i];
+                parts[count - 1 - i] = temp;
+            }
+            return VALUE_OBJ(objstring_conc_n(parts, count));
+        }
         default:
             fatal_printf("Undefined ast_type in ast_eval()!\nast_type = %d\n", root->type);
     }
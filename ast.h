@@ -22,6 +22,11 @@ typedef enum {
     AST_LESS = 12, 
     AST_ELESS = 13,
     AST_ASSIGN = 14,
+    //compound assignment, in the same order as AST_ADD...AST_DIV
+    AST_ADD_ASSIGN,
+    AST_SUB_ASSIGN,
+    AST_MUL_ASSIGN,
+    AST_DIV_ASSIGN,
 
     /*ast node contains pointer to obj_id_t*/
     AST_POSTINCR,
@@ -35,10 +40,15 @@ typedef enum {
     AST_STRING,
     AST_IDENT,
 
-    AST_CALL
+    AST_CALL,
+    /*ast node contains pointer to struct ast_call_arg with parts of the string in reverse order*/
+    AST_INTERP
 }ast_node_type;
 
 #define AST_IS_BIN_OP(op) (AST_ADD <= (op) && (op) <= AST_PROPERTY)
+#define AST_IS_COMPOUND_ASSIGN(op) (AST_ADD_ASSIGN <= (op) && (op) <= AST_DIV_ASSIGN)
+//arithmetic operation of the compound assignment
+#define AST_COMPOUND_OP(op) ((op) - AST_ADD_ASSIGN + AST_ADD)
 
 typedef union{
     void* ptr;
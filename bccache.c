@@ -0,0 +1,670 @@
+#include "bccache.h"
+#include "hash_table.h"
+#include "scanner.h"
+#include "symtable.h"
+#include "memo.h"
+#include "utils.h"
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+extern struct hash_table symtable;
+
+#define BCCACHE_MAGIC "ENMAC"
+#define BCCACHE_SOURCE_EXT ".enma"
+//the cache of another build of the interpreter may have other opcodes
+#define BCCACHE_BUILD (__DATE__ " " __TIME__)
+//reference to NULL in _data section
+#define OBJ_INDEX_NULL (UINT32_MAX)
+#define FNV_OFFSET_BASIS (14695981039346656037ull)
+//sections that are used from the mapped file start at page boundaries
+#define BCCACHE_ALIGNMENT (4096)
+
+//all objects that are referenced from the chunk and the symtable sorted by type and address
+struct object_table{
+    obj_t** objs;
+    size_t count;
+    size_t capacity;
+};
+
+struct writer{
+    FILE* fp;
+    uint64_t checksum; //of all bytes that are written
+    size_t offset;
+};
+
+struct reader{
+    const byte_t* start;
+    const byte_t* pos;
+    const byte_t* end;
+    bool is_ok;
+    obj_t** objs; //objects that are already loaded
+    uint32_t objs_count;
+    size_t code_size;
+};
+
+static bool collect_objects(struct object_table* t, const struct bytecode_chunk* chunk);
+static bool collect_object(struct object_table* t, obj_t* obj);
+static int compare_objects(const void* a, const void* b);
+static uint32_t object_index(const struct object_table* t, const obj_t* obj);
+static void write_header(struct writer* w, uint64_t source_hash);
+static void write_object(struct writer* w, const struct object_table* t, const obj_t* obj);
+static void write_value(struct writer* w, const struct object_table* t, value_t val);
+static void write_section(struct writer* w, const void* data, size_t size);
+static void write_image_section(struct writer* w, const void* data, size_t size);
+static inline void write_u32(struct writer* w, uint32_t num);
+static void write_bytes(struct writer* w, const void* data, size_t size);
+static inline uint64_t hash_bytes(uint64_t hash, const byte_t* data, size_t size);
+static bool read_header(struct reader* r, uint64_t source_hash);
+//return false if some of the imported files is changed
+static bool read_imports(struct reader* r);
+static obj_t* read_object(struct reader* r);
+static obj_t* read_ref(struct reader* r, obj_type type);
+static value_t read_value(struct reader* r);
+static const byte_t* read_section(struct reader* r, size_t* size);
+static const byte_t* read_image_section(struct reader* r, size_t* size);
+static const byte_t* read_bytes(struct reader* r, size_t size);
+static inline uint32_t read_u32(struct reader* r);
+static void load_section(struct chunk* section, const void* data, size_t size);
+static void map_section(struct chunk* section, const byte_t* data, size_t size);
+//checks that runs start at the beginning of the code and their offsets grow
+static bool is_line_table(const byte_t* lines, size_t size, size_t code_size);
+
+char* bccache_path(const char* source_path){
+    size_t len = strlen(source_path);
+    size_t ext_len = strlen(BCCACHE_SOURCE_EXT);
+    char* path = emalloc(len + ext_len + 2);
+    if(len > ext_len && strcmp(source_path + len - ext_len, BCCACHE_SOURCE_EXT) == 0)
+        sprintf(path, "%sc", source_path);
+    else
+        sprintf(path, "%s%sc", source_path, BCCACHE_SOURCE_EXT);
+    return path;
+}
+
+uint64_t bccache_hash_file(FILE* fp){
+    uint64_t hash = FNV_OFFSET_BASIS;
+    byte_t buf[4096];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        hash = hash_bytes(hash, buf, n);
+    rewind(fp);
+    return hash;
+}
+
+bool bccache_save(const struct bytecode_chunk* chunk, const char* path, uint64_t source_hash){
+    struct object_table t = {.objs = NULL, .count = 0, .capacity = 0};
+    if(!collect_objects(&t, chunk)){
+        dprintf("Bytecode cache: the chunk contains objects that cannot be saved\n");
+        free(t.objs);
+        return false;
+    }
+    //the file is replaced at once, so other processes never read a part of it
+    char* tmp_path = emalloc(strlen(path) + 32);
+    sprintf(tmp_path, "%s.%ld.tmp", path, (long)getpid());
+    struct writer writer = {.fp = fopen(tmp_path, "wb"), .checksum = FNV_OFFSET_BASIS, .offset = 0};
+    struct writer* w = &writer;
+    if(w->fp == NULL){
+        dprintf("Bytecode cache: failed to create %s\n", tmp_path);
+        free(tmp_path);
+        free(t.objs);
+        return false;
+    }
+
+    write_header(w, source_hash);
+    write_image_section(w, chunk->_code.data, chunk->_code.size);
+    write_section(w, chunk->_line_data.data, chunk->_line_data.size);
+    //objects are written as relocations, their slots are zeroed
+    const int* relocations = (const int*)chunk->_relocations.data;
+    size_t relocations_count = chunk->_relocations.size / sizeof(int);
+    byte_t* data = emalloc(chunk->_data.size + 1);
+    memcpy(data, chunk->_data.data, chunk->_data.size);
+    for(size_t i = 0; i < relocations_count; i++)
+        memset(data + relocations[i], 0, sizeof(union _inner_value_t));
+    write_image_section(w, data, chunk->_data.size);
+    free(data);
+    write_image_section(w, chunk->_handlers.data, chunk->_handlers.size);
+
+    write_u32(w, t.count);
+    for(size_t i = 0; i < t.count; i++)
+        write_object(w, &t, t.objs[i]);
+    write_u32(w, relocations_count);
+    for(size_t i = 0; i < relocations_count; i++){
+        write_u32(w, relocations[i]);
+        write_u32(w, object_index(&t, ((union _inner_value_t*)(chunk->_data.data + relocations[i]))->obj));
+    }
+    uint32_t entries = 0;
+    for(size_t i = 0; i < symtable.capacity; i++)
+        entries += symtable.entries[i].key != NULL;
+    write_u32(w, entries);
+    for(size_t i = 0; i < symtable.capacity; i++){
+        if(symtable.entries[i].key == NULL)
+            continue;
+        write_u32(w, object_index(&t, (obj_t*)symtable.entries[i].key));
+        write_value(w, &t, symtable.entries[i].value);
+    }
+    //the file ends with the checksum of its content
+    uint64_t checksum = w->checksum;
+    write_bytes(w, &checksum, sizeof(checksum));
+
+    bool is_ok = !ferror(w->fp);
+    is_ok = fclose(w->fp) == 0 && is_ok;
+    is_ok = is_ok && rename(tmp_path, path) == 0;
+    if(!is_ok){
+        dprintf("Bytecode cache: failed to write %s\n", path);
+        remove(tmp_path);
+    }
+    free(tmp_path);
+    free(t.objs);
+    return is_ok;
+}
+
+bool bccache_load(struct bytecode_chunk* chunk, const char* path, uint64_t source_hash){
+    //pages of the private mapping are shared with other processes until they are written
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat st;
+    uint64_t checksum;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(checksum)){
+        close(fd);
+        return false;
+    }
+    size_t image_size = st.st_size;
+    byte_t* image = mmap(NULL, image_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(image == MAP_FAILED)
+        return false;
+
+    //damaged file is not loaded
+    size_t size = image_size - sizeof(checksum);
+    memcpy(&checksum, image + size, sizeof(checksum));
+    struct reader r = {.start = image, .pos = image, .end = image + size, .is_ok = true, .objs = NULL, .objs_count = 0};
+    r.is_ok = hash_bytes(FNV_OFFSET_BASIS, image, size) == checksum;
+    size_t code_size = 0, lines_size = 0, data_size = 0, handlers_size = 0;
+    const byte_t *code = NULL, *lines = NULL, *data = NULL, *handlers = NULL;
+    if(read_header(&r, source_hash)){
+        code = read_image_section(&r, &code_size);
+        lines = read_section(&r, &lines_size);
+        data = read_image_section(&r, &data_size);
+        handlers = read_image_section(&r, &handlers_size);
+    }
+    r.is_ok = r.is_ok && code != NULL && is_line_table(lines, lines_size, code_size) &&
+        data_size % sizeof(union _inner_value_t) == 0 && handlers_size % sizeof(struct exception_handler) == 0;
+    r.code_size = code_size;
+
+    //every object takes at least 4 bytes
+    uint32_t count = r.is_ok ? read_u32(&r) : 0;
+    if(count > (size_t)(r.end - r.pos) / sizeof(uint32_t))
+        r.is_ok = false;
+    r.objs = emalloc(sizeof(obj_t*) * (r.is_ok ? count + 1 : 1));
+    while(r.is_ok && r.objs_count < count){
+        obj_t* obj = read_object(&r);
+        r.objs[r.objs_count++] = obj;
+    }
+
+    uint32_t relocations_count = r.is_ok ? read_u32(&r) : 0;
+    const byte_t* relocations = read_bytes(&r, (size_t)relocations_count * 2 * sizeof(uint32_t));
+    if(relocations == NULL)
+        relocations_count = 0;
+    int* offsets = emalloc(sizeof(int) * (relocations_count + 1));
+    obj_t** targets = emalloc(sizeof(obj_t*) * (relocations_count + 1));
+    for(uint32_t i = 0; r.is_ok && i < relocations_count; i++){
+        uint32_t pair[2];
+        memcpy(pair, relocations + i * sizeof(pair), sizeof(pair));
+        if(pair[0] % sizeof(union _inner_value_t) != 0 || pair[0] >= data_size ||
+           (pair[1] != OBJ_INDEX_NULL && pair[1] >= r.objs_count)){
+            r.is_ok = false;
+            break;
+        }
+        offsets[i] = pair[0];
+        targets[i] = pair[1] == OBJ_INDEX_NULL ? NULL : r.objs[pair[1]];
+    }
+
+    uint32_t entries = r.is_ok ? read_u32(&r) : 0;
+    if(entries > (size_t)(r.end - r.pos) / sizeof(uint32_t))
+        r.is_ok = false;
+    obj_id_t** keys = emalloc(sizeof(obj_id_t*) * (r.is_ok ? entries + 1 : 1));
+    value_t* values = emalloc(sizeof(value_t) * (r.is_ok ? entries + 1 : 1));
+    for(uint32_t i = 0; r.is_ok && i < entries; i++){
+        keys[i] = (obj_id_t*)read_ref(&r, OBJ_IDENTIFIER);
+        values[i] = read_value(&r);
+    }
+    bool is_ok = r.is_ok && r.pos == r.end;
+
+    if(is_ok){
+        map_section(&chunk->_code, code, code_size);
+        load_section(&chunk->_line_data, lines, lines_size);
+        map_section(&chunk->_data, data, data_size);
+        map_section(&chunk->_handlers, handlers, handlers_size);
+        load_section(&chunk->_relocations, offsets, sizeof(int) * relocations_count);
+        for(uint32_t i = 0; i < relocations_count; i++)
+            ((union _inner_value_t*)(chunk->_data.data + offsets[i]))->obj = targets[i];
+        for(uint32_t i = 0; i < entries; i++)
+            symtable_set(keys[i], values[i]);
+        chunk->image = image;
+        chunk->image_size = image_size;
+    }else{
+        dprintf("Bytecode cache: %s is not valid\n", path);
+        munmap(image, image_size);
+    }
+    free(keys);
+    free(values);
+    free(offsets);
+    free(targets);
+    free(r.objs);
+    return is_ok;
+}
+
+//return false if some of objects cannot be saved
+static bool collect_objects(struct object_table* t, const struct bytecode_chunk* chunk){
+    const int* relocations = (const int*)chunk->_relocations.data;
+    for(size_t i = 0; i < chunk->_relocations.size / sizeof(int); i++){
+        obj_t* obj = ((union _inner_value_t*)(chunk->_data.data + relocations[i]))->obj;
+        if(obj != NULL && !collect_object(t, obj))
+            return false;
+    }
+    for(size_t i = 0; i < symtable.capacity; i++){
+        const hash_entry* e = &symtable.entries[i];
+        if(e->key == NULL)
+            continue;
+        if(!collect_object(t, (obj_t*)e->key) || (IS_OBJ(e->value) && !collect_object(t, AS_OBJ(e->value))))
+            return false;
+    }
+    qsort(t->objs, t->count, sizeof(obj_t*), compare_objects);
+    size_t count = 0;
+    for(size_t i = 0; i < t->count; i++)
+        if(count == 0 || t->objs[count - 1] != t->objs[i])
+            t->objs[count++] = t->objs[i];
+    t->count = count;
+    return true;
+}
+
+//objects refer only to objects of previous types, so they are loaded in one pass
+static bool collect_object(struct object_table* t, obj_t* obj){
+    if(t->count == t->capacity){
+        t->capacity = t->capacity ? t->capacity * 2 : 256;
+        t->objs = erealloc(t->objs, sizeof(obj_t*) * t->capacity);
+    }
+    t->objs[t->count++] = obj;
+    switch(obj->type){
+        case OBJ_STRING: case OBJ_IDENTIFIER:
+            return true;
+        case OBJ_FUNCTION: case OBJ_NATFUNCTION:
+            return collect_object(t, (obj_t*)((obj_func_base_t*)obj)->name);
+        case OBJ_CLASS:{
+            obj_class_t* cl = (obj_class_t*)obj;
+            if(!collect_object(t, (obj_t*)cl->name))
+                return false;
+            for(size_t i = 0; i < cl->fields->capacity; i++)
+                if(cl->fields->entries[i].key != NULL && !collect_object(t, (obj_t*)cl->fields->entries[i].key))
+                    return false;
+            for(size_t i = 0; i < cl->methods->capacity; i++){
+                const hash_entry* e = &cl->methods->entries[i];
+                if(e->key != NULL && (!IS_OBJFUNCTION(e->value) ||
+                   !collect_object(t, (obj_t*)e->key) || !collect_object(t, AS_OBJ(e->value))))
+                    return false;
+            }
+            for(int i = 0; i <= CONSTRUCTORS_LIMIT && cl->constructors[i] != NULL; i++)
+                if(!collect_object(t, (obj_t*)cl->constructors[i]))
+                    return false;
+            return true;
+        }
+        default:
+            //instances are created only at run time
+            return false;
+    }
+}
+
+static int compare_objects(const void* a, const void* b){
+    const obj_t* o1 = *(const obj_t* const*)a;
+    const obj_t* o2 = *(const obj_t* const*)b;
+    if(o1->type != o2->type)
+        return o1->type < o2->type ? -1 : 1;
+    return o1 < o2 ? -1 : o1 > o2;
+}
+
+static uint32_t object_index(const struct object_table* t, const obj_t* obj){
+    if(obj == NULL)
+        return OBJ_INDEX_NULL;
+    size_t lo = 0, hi = t->count;
+    while(lo < hi){
+        size_t mid = (lo + hi) / 2;
+        if(compare_objects(&t->objs[mid], &obj) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void write_header(struct writer* w, uint64_t source_hash){
+    write_bytes(w, BCCACHE_MAGIC, sizeof(BCCACHE_MAGIC));
+    write_u32(w, BCCACHE_VERSION);
+    write_u32(w, OP_COUNT);
+    write_u32(w, sizeof(union _inner_value_t));
+    write_section(w, BCCACHE_BUILD, sizeof(BCCACHE_BUILD));
+    write_bytes(w, &source_hash, sizeof(source_hash));
+    //the first file is the main one, its hash is already written
+    int count;
+    char* const* files = scanner_files(&count);
+    write_u32(w, count > 0 ? count - 1 : 0);
+    for(int i = 1; i < count; i++){
+        FILE* fp = fopen(files[i], "r");
+        uint64_t hash = fp != NULL ? bccache_hash_file(fp) : 0;
+        if(fp != NULL)
+            fclose(fp);
+        write_section(w, files[i], strlen(files[i]) + 1);
+        write_bytes(w, &hash, sizeof(hash));
+    }
+}
+
+static void write_object(struct writer* w, const struct object_table* t, const obj_t* obj){
+    write_u32(w, obj->type);
+    switch(obj->type){
+        case OBJ_STRING: case OBJ_IDENTIFIER:
+            write_section(w, ((const obj_string_t*)obj)->str, ((const obj_string_t*)obj)->len);
+            break;
+        case OBJ_NATFUNCTION:
+            write_u32(w, object_index(t, (obj_t*)((const obj_natfunction_t*)obj)->base.name));
+            break;
+        case OBJ_FUNCTION:{
+            const obj_function_t* f = (const obj_function_t*)obj;
+            write_u32(w, object_index(t, (obj_t*)f->base.name));
+            write_u32(w, f->base.argc);
+            write_u32(w, f->entry_offset);
+            write_u32(w, f->is_pure);
+            write_u32(w, f->arg_types != NULL);
+            for(int i = 0; f->arg_types != NULL && i < f->base.argc; i++)
+                write_u32(w, f->arg_types[i]);
+            write_u32(w, f->memo != NULL ? memo_capacity(f->memo) : 0);
+            break;
+        }
+        case OBJ_CLASS:{
+            const obj_class_t* cl = (const obj_class_t*)obj;
+            write_u32(w, object_index(t, (obj_t*)cl->name));
+            write_u32(w, cl->fields->count);
+            for(size_t i = 0; i < cl->fields->capacity; i++){
+                if(cl->fields->entries[i].key == NULL)
+                    continue;
+                write_u32(w, object_index(t, (obj_t*)cl->fields->entries[i].key));
+                write_u32(w, AS_NUMBER(cl->fields->entries[i].value));
+            }
+            write_u32(w, cl->methods->count);
+            for(size_t i = 0; i < cl->methods->capacity; i++){
+                if(cl->methods->entries[i].key == NULL)
+                    continue;
+                write_u32(w, object_index(t, (obj_t*)cl->methods->entries[i].key));
+                write_u32(w, object_index(t, AS_OBJ(cl->methods->entries[i].value)));
+            }
+            int count = 0;
+            while(count <= CONSTRUCTORS_LIMIT && cl->constructors[count] != NULL)
+                count++;
+            write_u32(w, count);
+            for(int i = 0; i < count; i++)
+                write_u32(w, object_index(t, (obj_t*)cl->constructors[i]));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void write_value(struct writer* w, const struct object_table* t, value_t val){
+    write_u32(w, val.type);
+    switch(val.type){
+        case VT_BOOL: write_u32(w, AS_BOOLEAN(val)); break;
+        case VT_NUMBER: write_bytes(w, &AS_NUMBER(val), sizeof(double)); break;
+        case VT_OBJ: write_u32(w, object_index(t, AS_OBJ(val))); break;
+        default: break;
+    }
+}
+
+//the data starts at the aligned offset in the file
+static void write_image_section(struct writer* w, const void* data, size_t size){
+    static const byte_t padding[BCCACHE_ALIGNMENT] = {0};
+    write_u32(w, size);
+    write_bytes(w, padding, (BCCACHE_ALIGNMENT - w->offset % BCCACHE_ALIGNMENT) % BCCACHE_ALIGNMENT);
+    if(size > 0)
+        write_bytes(w, data, size);
+}
+
+static void write_section(struct writer* w, const void* data, size_t size){
+    write_u32(w, size);
+    if(size > 0)
+        write_bytes(w, data, size);
+}
+
+static inline void write_u32(struct writer* w, uint32_t num){
+    write_bytes(w, &num, sizeof(num));
+}
+
+static void write_bytes(struct writer* w, const void* data, size_t size){
+    w->checksum = hash_bytes(w->checksum, data, size);
+    w->offset += size;
+    fwrite(data, 1, size, w->fp);
+}
+
+//FNV-1a
+static inline uint64_t hash_bytes(uint64_t hash, const byte_t* data, size_t size){
+    for(size_t i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    return hash;
+}
+
+static bool read_header(struct reader* r, uint64_t source_hash){
+    const byte_t* magic = read_bytes(r, sizeof(BCCACHE_MAGIC));
+    if(magic == NULL || memcmp(magic, BCCACHE_MAGIC, sizeof(BCCACHE_MAGIC)) != 0)
+        return false;
+    if(read_u32(r) != BCCACHE_VERSION || read_u32(r) != OP_COUNT || read_u32(r) != sizeof(union _inner_value_t))
+        return false;
+    size_t size;
+    const byte_t* build = read_section(r, &size);
+    if(build == NULL || size != sizeof(BCCACHE_BUILD) || memcmp(build, BCCACHE_BUILD, size) != 0)
+        return false;
+    const byte_t* hash = read_bytes(r, sizeof(source_hash));
+    return hash != NULL && memcmp(hash, &source_hash, sizeof(source_hash)) == 0 && read_imports(r);
+}
+
+static bool read_imports(struct reader* r){
+    uint32_t count = read_u32(r);
+    for(uint32_t i = 0; r->is_ok && i < count; i++){
+        size_t size;
+        const char* path = (const char*)read_section(r, &size);
+        const byte_t* hash = read_bytes(r, sizeof(uint64_t));
+        if(path == NULL || hash == NULL || size == 0 || path[size - 1] != '\0')
+            return false;
+        FILE* fp = fopen(path, "r");
+        if(fp == NULL)
+            return false;
+        uint64_t file_hash = bccache_hash_file(fp);
+        fclose(fp);
+        if(memcmp(hash, &file_hash, sizeof(file_hash)) != 0){
+            dprintf("Bytecode cache: %s is changed\n", path);
+            return false;
+        }
+    }
+    return r->is_ok;
+}
+
+static obj_t* read_object(struct reader* r){
+    obj_type type = read_u32(r);
+    if(!r->is_ok)
+        return NULL;
+    switch(type){
+        case OBJ_STRING: case OBJ_IDENTIFIER:{
+            size_t len;
+            const char* s = (const char*)read_section(r, &len);
+            if(s == NULL)
+                return NULL;
+            if(type == OBJ_STRING)
+                return (obj_t*)stringtable_findstr(s, len, hash_string(s, len));
+            return (obj_t*)symtable_findstr(s, len, hash_string(s, len));
+        }
+        case OBJ_NATFUNCTION:{
+            obj_id_t* name = (obj_id_t*)read_ref(r, OBJ_IDENTIFIER);
+            value_t val;
+            if(name == NULL || !symtable_get(name, &val) || !IS_OBJNATFUNCTION(val))
+                break;
+            return AS_OBJ(val);
+        }
+        case OBJ_FUNCTION:{
+            obj_string_t* name = (obj_string_t*)read_ref(r, OBJ_IDENTIFIER);
+            int argc = read_u32(r);
+            int entry = read_u32(r);
+            bool is_pure = read_u32(r);
+            bool has_types = read_u32(r);
+            if(!r->is_ok || argc < 0 || (size_t)argc > (size_t)(r->end - r->pos) || entry < -1 || entry >= (int)r->code_size)
+                break;
+            obj_function_t* f = mk_objfunc(name);
+            f->base.argc = argc;
+            f->entry_offset = entry;
+            f->is_pure = is_pure;
+            if(has_types){
+                f->arg_types = emalloc(sizeof(static_type) * (argc + 1));
+                for(int i = 0; i < argc; i++)
+                    if((f->arg_types[i] = read_u32(r)) > ST_STR)
+                        r->is_ok = false;
+            }
+            int capacity = read_u32(r);
+            if(capacity < 0 || capacity > MEMO_MAX_CAPACITY)
+                r->is_ok = false;
+            else if(capacity > 0)
+                f->memo = memo_create(argc, capacity);
+            return (obj_t*)f;
+        }
+        case OBJ_CLASS:{
+            obj_id_t* name = (obj_id_t*)read_ref(r, OBJ_IDENTIFIER);
+            if(name == NULL)
+                break;
+            obj_class_t* cl = mk_objclass(name);
+            uint32_t fields = read_u32(r);
+            for(uint32_t i = 0; r->is_ok && i < fields; i++){
+                obj_id_t* field = (obj_id_t*)read_ref(r, OBJ_IDENTIFIER);
+                uint32_t idx = read_u32(r);
+                if(r->is_ok && idx < fields)
+                    table_set(cl->fields, field, VALUE_NUMBER(idx));
+                else
+                    r->is_ok = false;
+            }
+            uint32_t methods = read_u32(r);
+            for(uint32_t i = 0; r->is_ok && i < methods; i++){
+                obj_id_t* meth = (obj_id_t*)read_ref(r, OBJ_IDENTIFIER);
+                obj_t* func = read_ref(r, OBJ_FUNCTION);
+                if(r->is_ok)
+                    table_set(cl->methods, meth, VALUE_OBJ(func));
+            }
+            uint32_t constructors = read_u32(r);
+            if(constructors > CONSTRUCTORS_LIMIT + 1)
+                r->is_ok = false;
+            for(uint32_t i = 0; r->is_ok && i <= CONSTRUCTORS_LIMIT; i++)
+                cl->constructors[i] = i < constructors ? (obj_function_t*)read_ref(r, OBJ_FUNCTION) : NULL;
+            return (obj_t*)cl;
+        }
+        default:
+            break;
+    }
+    r->is_ok = false;
+    return NULL;
+}
+
+//reference to a previous object of the type
+static obj_t* read_ref(struct reader* r, obj_type type){
+    uint32_t idx = read_u32(r);
+    if(!r->is_ok || idx >= r->objs_count || r->objs[idx]->type != type){
+        r->is_ok = false;
+        return NULL;
+    }
+    return r->objs[idx];
+}
+
+static value_t read_value(struct reader* r){
+    value_t val = {.type = read_u32(r)};
+    switch(val.type){
+        case VT_NONE: case VT_UNINIT:
+            break;
+        case VT_BOOL:
+            val.as.boolean = read_u32(r);
+            break;
+        case VT_NUMBER:{
+            const byte_t* num = read_bytes(r, sizeof(double));
+            if(num != NULL)
+                memcpy(&val.as.number, num, sizeof(double));
+            break;
+        }
+        case VT_OBJ:{
+            uint32_t idx = read_u32(r);
+            if(r->is_ok && idx < r->objs_count)
+                val.as.obj = r->objs[idx];
+            else
+                r->is_ok = false;
+            break;
+        }
+        default:
+            r->is_ok = false;
+            break;
+    }
+    return val;
+}
+
+static const byte_t* read_image_section(struct reader* r, size_t* size){
+    *size = read_u32(r);
+    read_bytes(r, (BCCACHE_ALIGNMENT - (r->pos - r->start) % BCCACHE_ALIGNMENT) % BCCACHE_ALIGNMENT);
+    return read_bytes(r, *size);
+}
+
+static const byte_t* read_section(struct reader* r, size_t* size){
+    *size = read_u32(r);
+    return read_bytes(r, *size);
+}
+
+static const byte_t* read_bytes(struct reader* r, size_t size){
+    if(!r->is_ok || size > (size_t)(r->end - r->pos)){
+        r->is_ok = false;
+        return NULL;
+    }
+    const byte_t* res = r->pos;
+    r->pos += size;
+    return res;
+}
+
+static inline uint32_t read_u32(struct reader* r){
+    uint32_t num = 0;
+    const byte_t* p = read_bytes(r, sizeof(num));
+    if(p != NULL)
+        memcpy(&num, p, sizeof(num));
+    return num;
+}
+
+//the section is not owned by the chunk, it is copied to the heap if it grows
+static void map_section(struct chunk* section, const byte_t* data, size_t size){
+    if(section->capacity > 0)
+        free(section->data);
+    section->data = (byte_t*)data;
+    section->size = size;
+    section->capacity = 0;
+}
+
+//capacity of an empty section stays positive, so it may grow
+static void load_section(struct chunk* section, const void* data, size_t size){
+    section->data = erealloc(section->data, size > 0 ? size : 1);
+    if(size > 0)
+        memcpy(section->data, data, size);
+    section->size = size;
+    section->capacity = size > 0 ? size : 1;
+}
+
+static bool is_line_table(const byte_t* lines, size_t size, size_t code_size){
+    if(lines == NULL || size == 0 || size % sizeof(struct line_run) != 0)
+        return false;
+    int prev = -1;
+    for(size_t i = 0; i < size; i += sizeof(struct line_run)){
+        struct line_run run;
+        memcpy(&run, lines + i, sizeof(run));
+        if(run.offset <= prev || (size_t)run.offset >= code_size || (i == 0 && run.offset != 0))
+            return false;
+        prev = run.offset;
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef BCCACHE_H
+#define BCCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "bytecode.h"
+
+/*
+Precompiled bytecode is saved in a cache file next to the source (prog.enma -> prog.enmac)
+and loaded instead of compiling the source if the hash of the source is the same.
+The file contains:
+ - header: magic, format version, build of the interpreter, count of instructions and hash of the source,
+   real paths and hashes of all imported files, the cache is not used if some of them is changed
+ - object table: strings, identifiers, functions, native functions (by name) and classes,
+   references between objects are indices in the table and point only to previous objects
+ - _code, _data and _handlers sections as they are, each one aligned to a page,
+   the file is mapped copy-on-write and the sections are used in place
+ - _line_data runs between _code and _data, it is small and copied to the heap
+ - relocations: offsets in _data section and indices of objects that are written there
+ - symtable: identifiers with their values (globals, functions and classes)
+ - checksum of the whole content, a damaged file is compiled again
+*/
+
+#define BCCACHE_VERSION (5)
+
+//return path of the cache file for the source, it must be freed
+char* bccache_path(const char* source_path);
+//hash of the whole content of the file, the file is rewound
+uint64_t bccache_hash_file(FILE* fp);
+//writes the compiled chunk and the symtable, return false if the chunk cannot be saved
+bool bccache_save(const struct bytecode_chunk* chunk, const char* path, uint64_t source_hash);
+//return false if there is no valid cache for the source, the chunk and values in the symtable are not changed then
+//otherwise the chunk and the symtable are filled like after compilation
+bool bccache_load(struct bytecode_chunk* chunk, const char* path, uint64_t source_hash);
+
+#endif
@@ -4,11 +4,16 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 #include "ast.h"
 #include "lang_types.h"
 #include "scope.h"
 #include "utils.h"
 #include "symtable.h"
+#include "hash_table.h"
+#include "vm.h"
+#include "profile.h"
 
 static void chunk_init(struct chunk* chunk);
 static void chunk_write(struct chunk* chunk, byte_t byte);
@@ -18,26 +23,70 @@ static void chunk_free(struct chunk* chunk);
 static inline void chunk_realloc(struct chunk* chunk, size_t newsize);
 
 static inline void bcchunk_write_code(struct bytecode_chunk* chunk, byte_t byte, int line);
-static inline void bcchunk_write_data(struct bytecode_chunk* chunk, byte_t byte);
+//adds the run to _line_data if the line of the code at offset differs from the previous one
+static inline void line_write(struct bytecode_chunk* chunk, int offset, int line);
+//writes the value in _data section, offsets of objects are added to _relocations
+static void data_write_value(struct bytecode_chunk* chunk, value_t val);
+//return offset of the equal constant in _data section, it is written there if it is new
+static int data_intern_value(struct bytecode_chunk* chunk, value_t val);
+static uint64_t constant_bits(value_t val);
+static inline size_t constant_hash(uint64_t bits, value_type type);
+static void constant_index_grow(struct constant_index* index);
+#define CONSTANT_INDEX_BASE_CAPACITY (64)
 
 static void parse_ast_bin_expr(const ast_node* node, struct bytecode_chunk* chunk, int line);
+//return type of the expression if it can be proven at compile time
+static static_type infer_type(const ast_node* node);
 static inline value_t readvalue(const struct bytecode_chunk* chunk, size_t code_offset);
 static int bcchunk_parse_call_args(struct ast_call_arg* p, struct bytecode_chunk* chunk, int line);
 static void bcchunk_clear_args(struct bytecode_chunk* chunk, int argc, int line);
 static value_t extract_callable(struct ast_call_info* info);
+static bool eval_constant(const ast_node* node, value_t* val);
+//switch table may have twice as many entries as cases
+#define SWITCH_DENSITY (2)
+//fields in one OP_GET_PATH, longer chains are split
+#define PATH_LENGTH_LIMIT (16)
+static int write_jump(struct bytecode_chunk* chunk, op_t op, int list, int line);
+static int write_cond_jump(const ast_node* node, bool jump_if, int list, struct bytecode_chunk* chunk, int line);
+static bool eval_pure_call(const struct ast_call_info* info, value_t* result);
+//writes OP_CONCAT_N for 'a + b + c...' chain if some of operands are strings
+static bool write_concat(const ast_node* node, struct bytecode_chunk* chunk, int line);
+static int write_concat_operands(const ast_node* node, struct bytecode_chunk* chunk, int line);
+static bool has_string_operand(const ast_node* node, int* count);
+static int write_interp_parts(const struct ast_call_arg* p, struct bytecode_chunk* chunk, int line);
+//writes 'a.b.c...' chain of fields with OP_GET_PATH
+static void write_field_path(const ast_node* node, struct bytecode_chunk* chunk, int line);
 static void bcchunk_write_constructor(obj_class_t* cl, int argc, struct bytecode_chunk* chunk, int line);
-static void bcchunk_write_method(struct bytecode_chunk*chunk, obj_id_t* id, int argc, int line){
+//receiver is a class of the instance if it is known at compile time
+static void bcchunk_write_method(struct bytecode_chunk*chunk, obj_class_t* receiver, obj_id_t* id, int argc, int line){
+    //the profiled run may know the class when the compiler does not
+    obj_class_t* seen = profile_next_site(PROFILE_METHOD_SITE);
+    if(receiver == NULL)
+        receiver = seen;
+    value_t meth;
+    if(receiver != NULL && table_check(receiver->methods, id, &meth) && AS_OBJFUNCTION(meth)->base.argc == argc){
+        //the instance may be reassigned, so the call is guarded by its class
+        bcchunk_write_simple_op(chunk, OP_INVOKE, line);
+        bcchunk_write_value(chunk, VALUE_OBJ(receiver), line);
+        bcchunk_write_value(chunk, meth, line);
+    }else{
         bcchunk_write_simple_op(chunk, OP_NUMBER, line);
         bcchunk_write_value(chunk, VALUE_NUMBER(argc), line);
         bcchunk_write_simple_op(chunk, OP_METHOD, line);
         bcchunk_write_value(chunk, VALUE_OBJ(id), line);
-        bcchunk_clear_args(chunk, argc + 1, line);
+    }
+    bcchunk_clear_args(chunk, argc + 1, line);
 }
 
 #ifdef DEBUG
 static inline void print_instruction_debug(const char* name, const struct bytecode_chunk* chunk, size_t offset);
 static inline size_t simple_instruction_debug(const char* name, const struct bytecode_chunk* chunk, size_t offset);
 static inline size_t constant_instruction_debug(const char* name, const struct bytecode_chunk* chunk, size_t offset);
+static inline size_t short_instruction_debug(const char* name, const struct bytecode_chunk* chunk, size_t offset);
+static inline size_t invoke_instruction_debug(const char* name, const struct bytecode_chunk* chunk, size_t offset);
+static inline size_t forloop_instruction_debug(const char* name, const struct bytecode_chunk* chunk, size_t offset);
+static inline size_t concat_instruction_debug(const char* name, const struct bytecode_chunk* chunk, size_t offset);
+static inline size_t native_instruction_debug(const char* name, const struct bytecode_chunk* chunk, size_t offset);
 #endif
 
 static void chunk_init(struct chunk* chunk){
@@ -48,58 +97,177 @@ static void chunk_init(struct chunk* chunk){
 
 static void chunk_free(struct chunk* chunk){
     chunk->size = 0;
+    if(chunk->capacity > 0)
+        free(chunk->data);
     chunk->capacity = 0;
-    free(chunk->data);
     chunk->data = NULL;
 }
 
+//sections grow geometrically, so writing a large program takes linear time
 static void chunk_write(struct chunk* chunk, byte_t byte){
     if (chunk->capacity <= chunk->size)
-        chunk_realloc(chunk, chunk->capacity + CHUNK_BASE_CAPACITY);
+        chunk_realloc(chunk, 2 * chunk->capacity + CHUNK_BASE_CAPACITY);
     chunk->data[chunk->size++] = byte;
 }
 
 static void chunk_write_number(struct chunk* chunk, int number){
     if (chunk->capacity < chunk->size + sizeof(number))
-        chunk_realloc(chunk, chunk->capacity + CHUNK_BASE_CAPACITY);
+        chunk_realloc(chunk, 2 * chunk->capacity + CHUNK_BASE_CAPACITY);
     *((int*)(chunk->data + chunk->size)) = number;
     chunk->size += sizeof(number);
 }
 
 static void chunk_write_value(struct chunk* chunk, value_t val){
     if (chunk->capacity < chunk->size + sizeof(val.as))
-        chunk_realloc(chunk, chunk->capacity + CHUNK_BASE_CAPACITY);
+        chunk_realloc(chunk, 2 * chunk->capacity + CHUNK_BASE_CAPACITY);
     *((union _inner_value_t*)(chunk->data + chunk->size)) = val.as;
     chunk->size += sizeof(val.as);
 }
 
 static inline void chunk_realloc(struct chunk* chunk, size_t newsize){
+    //mapped section is copied to the heap when it grows
+    if(chunk->capacity == 0 && chunk->data != NULL){
+        if(newsize < chunk->size + CHUNK_BASE_CAPACITY)
+            newsize = chunk->size + CHUNK_BASE_CAPACITY;
+        byte_t* data = emalloc(newsize);
+        memcpy(data, chunk->data, chunk->size);
+        chunk->data = data;
+        chunk->capacity = newsize;
+        return;
+    }
     if((chunk->capacity = newsize) == 0)
         fatal_printf("chunk_realloc(): newsize = 0!\n");
     chunk->data = erealloc(chunk->data, newsize);
-    chunk->size = chunk->size > newsize ? chunk->size : newsize;
+    chunk->size = chunk->size < newsize ? chunk->size : newsize;
 }
 
 void bcchunk_init(struct bytecode_chunk* chunk){
     chunk_init(&chunk->_code);
     chunk_init(&chunk->_data);
     chunk_init(&chunk->_line_data);
+    chunk_init(&chunk->_handlers);
+    chunk_init(&chunk->_relocations);
+    chunk->_constants = (struct constant_index){.entries = NULL, .count = 0, .capacity = 0};
+    chunk->image = NULL;
+    chunk->image_size = 0;
 }
 
 void bcchunk_free(struct bytecode_chunk* chunk){
     chunk_free(&chunk->_code);
     chunk_free(&chunk->_data);
     chunk_free(&chunk->_line_data);
+    chunk_free(&chunk->_handlers);
+    chunk_free(&chunk->_relocations);
+    free(chunk->_constants.entries);
+    chunk->_constants = (struct constant_index){.entries = NULL, .count = 0, .capacity = 0};
+    if(chunk->image != NULL)
+        munmap(chunk->image, chunk->image_size);
+    chunk->image = NULL;
+}
+
+void bcchunk_add_handler(struct bytecode_chunk* chunk, const struct exception_handler* handler){
+    chunk_write_number(&chunk->_handlers, handler->start);
+    chunk_write_number(&chunk->_handlers, handler->end);
+    chunk_write_number(&chunk->_handlers, handler->target);
+    chunk_write_number(&chunk->_handlers, handler->depth);
+}
+
+const struct exception_handler* bcchunk_find_handler(const struct bytecode_chunk* chunk, int offset){
+    const struct exception_handler* handlers = (const struct exception_handler*)chunk->_handlers.data;
+    size_t count = chunk->_handlers.size / sizeof(struct exception_handler);
+    for(size_t i = 0; i < count; i++)
+        if(handlers[i].start <= offset && offset < handlers[i].end)
+            return &handlers[i];
+    return NULL;
 }
 
 static inline void bcchunk_write_code(struct bytecode_chunk* chunk, byte_t byte, int line){
+    line_write(chunk, chunk->_code.size, line);
     chunk_write(&chunk->_code, byte);
+}
+
+static inline void line_write(struct bytecode_chunk* chunk, int offset, int line){
+    size_t count = chunk->_line_data.size / sizeof(struct line_run);
+    if(count > 0 && ((const struct line_run*)chunk->_line_data.data)[count - 1].line == line)
+        return;
+    chunk_write_number(&chunk->_line_data, offset);
     chunk_write_number(&chunk->_line_data, line);
 }
 
+int bcchunk_get_line(const struct bytecode_chunk* chunk, int offset){
+    const struct line_run* runs = (const struct line_run*)chunk->_line_data.data;
+    size_t lo = 0, hi = chunk->_line_data.size / sizeof(struct line_run);
+    if(hi == 0)
+        return 0;
+    //the last run that starts at or before the offset
+    while(hi - lo > 1){
+        size_t mid = lo + (hi - lo) / 2;
+        if(runs[mid].offset <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return runs[lo].line;
+}
+
 
-static inline void bcchunk_write_data(struct bytecode_chunk* chunk, byte_t byte){
-    chunk_write(&chunk->_data, byte);
+static void data_write_value(struct bytecode_chunk* chunk, value_t val){
+    if(IS_OBJ(val))
+        chunk_write_number(&chunk->_relocations, chunk->_data.size);
+    chunk_write_value(&chunk->_data, val);
+}
+
+static uint64_t constant_bits(value_t val){
+    uint64_t bits = 0;
+    if(IS_NUMBER(val)){
+        double num = AS_NUMBER(val); //-0 and 0 are different constants
+        memcpy(&bits, &num, sizeof(num));
+    }else if(IS_BOOLEAN(val)){
+        bits = AS_BOOLEAN(val);
+    }else{
+        bits = (uint64_t)(uintptr_t)AS_OBJ(val);
+    }
+    return bits;
+}
+
+static inline size_t constant_hash(uint64_t bits, value_type type){
+    return ((bits ^ (bits >> 29) ^ type) * 0x9E3779B97F4A7C15ull) >> 32;
+}
+
+static void constant_index_grow(struct constant_index* index){
+    struct constant_entry* old = index->entries;
+    size_t old_capacity = index->capacity;
+    index->capacity = old_capacity == 0 ? CONSTANT_INDEX_BASE_CAPACITY : old_capacity * 2;
+    index->entries = emalloc(sizeof(struct constant_entry) * index->capacity);
+    for(size_t i = 0; i < index->capacity; i++)
+        index->entries[i].offset = -1;
+    for(size_t i = 0; i < old_capacity; i++){
+        if(old[i].offset < 0)
+            continue;
+        size_t mask = index->capacity - 1;
+        size_t idx = constant_hash(old[i].bits, old[i].type) & mask;
+        while(index->entries[idx].offset >= 0)
+            idx = (idx + 1) & mask;
+        index->entries[idx] = old[i];
+    }
+    free(old);
+}
+
+static int data_intern_value(struct bytecode_chunk* chunk, value_t val){
+    struct constant_index* index = &chunk->_constants;
+    if((index->count + 1) * 4 > index->capacity * 3)
+        constant_index_grow(index);
+    uint64_t bits = constant_bits(val);
+    size_t mask = index->capacity - 1;
+    size_t idx = constant_hash(bits, val.type) & mask;
+    for(; index->entries[idx].offset >= 0; idx = (idx + 1) & mask)
+        if(index->entries[idx].bits == bits && index->entries[idx].type == val.type)
+            return index->entries[idx].offset;
+    int offset = chunk->_data.size;
+    data_write_value(chunk, val);
+    index->entries[idx] = (struct constant_entry){.bits = bits, .type = val.type, .offset = offset};
+    index->count++;
+    return offset;
 }
 
 #ifdef DEBUG
@@ -129,8 +297,9 @@ size_t instruction_debug(const struct bytecode_chunk* chunk, size_t offset){
         case OP_POPN: return constant_instruction_debug(op_to_string(op), chunk, offset);
         case OP_JUMP: return constant_instruction_debug(op_to_string(op), chunk, offset);
         case OP_FJUMP: return constant_instruction_debug(op_to_string(op), chunk, offset);
+        case OP_TJUMP: return constant_instruction_debug(op_to_string(op), chunk, offset);
         case OP_CALL: return constant_instruction_debug(op_to_string(op), chunk, offset);
-        case OP_NATIVE_CALL: return constant_instruction_debug(op_to_string(op), chunk, offset);
+        case OP_NATIVE_CALL: return native_instruction_debug(op_to_string(op), chunk, offset);
         case OP_PREFINCR_GLOBAL: return constant_instruction_debug(op_to_string(op), chunk, offset);
         case OP_PREFINCR_LOCAL: return constant_instruction_debug(op_to_string(op), chunk, offset);
         case OP_PREFDECR_LOCAL: return constant_instruction_debug(op_to_string(op), chunk, offset);
@@ -145,6 +314,36 @@ size_t instruction_debug(const struct bytecode_chunk* chunk, size_t offset){
         case OP_GET_FIELD: return constant_instruction_debug(op_to_string(op), chunk, offset);
         case OP_SET_FIELD: return constant_instruction_debug(op_to_string(op), chunk, offset);
         case OP_METHOD: return constant_instruction_debug(op_to_string(op), chunk, offset);
+        case OP_ADD_NUM: return simple_instruction_debug(op_to_string(op),chunk, offset);
+        case OP_SUB_NUM: return simple_instruction_debug(op_to_string(op),chunk, offset);
+        case OP_MUL_NUM: return simple_instruction_debug(op_to_string(op),chunk, offset);
+        case OP_DIV_NUM: return simple_instruction_debug(op_to_string(op),chunk, offset);
+        case OP_EQUAL_NUM: return simple_instruction_debug(op_to_string(op),chunk, offset);
+        case OP_GREATER_NUM: return simple_instruction_debug(op_to_string(op),chunk, offset);
+        case OP_LESS_NUM: return simple_instruction_debug(op_to_string(op),chunk, offset);
+        case OP_CHECK_TYPE: return constant_instruction_debug(op_to_string(op), chunk, offset);
+        case OP_CHECK_ARGS: return constant_instruction_debug(op_to_string(op), chunk, offset);
+        case OP_INVOKE: return invoke_instruction_debug(op_to_string(op), chunk, offset);
+        case OP_FORLOOP_LESS: case OP_FORLOOP_ELESS:
+        case OP_FORLOOP_GREATER: case OP_FORLOOP_EGREATER:
+            return forloop_instruction_debug(op_to_string(op), chunk, offset);
+        case OP_SWITCH_TABLE: return constant_instruction_debug(op_to_string(op), chunk, offset);
+        case OP_SWITCH_HASH: return constant_instruction_debug(op_to_string(op), chunk, offset);
+        case OP_GET_PATH: return constant_instruction_debug(op_to_string(op), chunk, offset);
+        case OP_IS_NUM: case OP_IS_STR: case OP_IS_BOOL: case OP_IS_INST: case OP_IS_NONE: case OP_IS_UNINIT:
+        case OP_SQRT: case OP_FLOOR: case OP_ABS: case OP_MIN: case OP_MAX: case OP_POW:
+        case OP_THROW:
+            return simple_instruction_debug(op_to_string(op), chunk, offset);
+        case OP_ADD_ASSIGN_LOCAL: case OP_SUB_ASSIGN_LOCAL: case OP_MUL_ASSIGN_LOCAL: case OP_DIV_ASSIGN_LOCAL:
+        case OP_ADD_ASSIGN_GLOBAL: case OP_SUB_ASSIGN_GLOBAL: case OP_MUL_ASSIGN_GLOBAL: case OP_DIV_ASSIGN_GLOBAL:
+        case OP_ADD_ASSIGN_FIELD: case OP_SUB_ASSIGN_FIELD: case OP_MUL_ASSIGN_FIELD: case OP_DIV_ASSIGN_FIELD:
+            return constant_instruction_debug(op_to_string(op), chunk, offset);
+        case OP_CONCAT_N: return concat_instruction_debug(op_to_string(op), chunk, offset);
+        case OP_MEMO_RETURN: return constant_instruction_debug(op_to_string(op), chunk, offset);
+        case OP_GET_LOCAL_0: case OP_GET_LOCAL_1: case OP_GET_LOCAL_2: case OP_GET_LOCAL_3:
+            return simple_instruction_debug(op_to_string(op), chunk, offset);
+        case OP_GET_LOCAL_SHORT: case OP_SET_LOCAL_SHORT: case OP_POPN_SHORT: case OP_CLARGS_SHORT:
+            return short_instruction_debug(op_to_string(op), chunk, offset);
         default:
             fatal_printf("Undefined instruction! Check instruction_debug().\n");
     }
@@ -152,7 +351,7 @@ size_t instruction_debug(const struct bytecode_chunk* chunk, size_t offset){
 }
 
 static inline void print_instruction_debug(const char* name, const struct bytecode_chunk* chunk, size_t offset){
-    printf("%10d | %04X | %s",((int*)chunk->_line_data.data)[offset], (unsigned)offset, name);
+    printf("%10d | %04X | %s",bcchunk_get_line(chunk, offset), (unsigned)offset, name);
 }
 
 static inline size_t simple_instruction_debug(const char* name, const struct bytecode_chunk* chunk, size_t offset){
@@ -183,39 +382,62 @@ static inline size_t constant_instruction_debug(const char* name, const struct b
             printf(" instance of class %s\n", ((obj_class_t*)extracted_value->obj)->name->str);
             break;
         }
-        case OP_SET_FIELD:case OP_GET_FIELD:case OP_METHOD:{
+        case OP_SET_FIELD:case OP_GET_FIELD:case OP_METHOD:
+        case OP_ADD_ASSIGN_FIELD: case OP_SUB_ASSIGN_FIELD: case OP_MUL_ASSIGN_FIELD: case OP_DIV_ASSIGN_FIELD:{
             printf(" [%s]\n", ((obj_id_t*)extracted_value->obj)->str);
             break;
         }
         case OP_GET_GLOBAL: case OP_SET_GLOBAL:
-        case OP_PREFINCR_GLOBAL: case OP_PREFDECR_GLOBAL:case OP_POSTINCR_GLOBAL: case OP_POSTDECR_GLOBAL:{
+        case OP_PREFINCR_GLOBAL: case OP_PREFDECR_GLOBAL:case OP_POSTINCR_GLOBAL: case OP_POSTDECR_GLOBAL:
+        case OP_ADD_ASSIGN_GLOBAL: case OP_SUB_ASSIGN_GLOBAL: case OP_MUL_ASSIGN_GLOBAL: case OP_DIV_ASSIGN_GLOBAL:{
             if(!(extracted_value->obj->type == OBJ_IDENTIFIER))
                 fatal_printf("constant_instruction_debug(): extracted object is not identifier\n");
             printf(" [\"%s\"] %p\n", ((obj_id_t*)(extracted_value->obj))->str,((obj_id_t*)(extracted_value->obj))->str);
             break;
         }
         case OP_GET_LOCAL: case OP_SET_LOCAL:
-        case OP_PREFINCR_LOCAL: case OP_PREFDECR_LOCAL:case OP_POSTINCR_LOCAL: case OP_POSTDECR_LOCAL:{
+        case OP_PREFINCR_LOCAL: case OP_PREFDECR_LOCAL:case OP_POSTINCR_LOCAL: case OP_POSTDECR_LOCAL:
+        case OP_ADD_ASSIGN_LOCAL: case OP_SUB_ASSIGN_LOCAL: case OP_MUL_ASSIGN_LOCAL: case OP_DIV_ASSIGN_LOCAL:{
             printf(" stack index: %d\n", extracted_value->number);
             break;
         }
-        case OP_POPN:case OP_JUMP: case OP_FJUMP:case OP_CLARGS:{
+        case OP_POPN:case OP_JUMP: case OP_FJUMP: case OP_TJUMP: case OP_CLARGS:{
             int val = *(int*)(chunk->_code.data + offset + 1);
             printf(" %d [0x%X]\n", val,val);
             break;
         }
-        case OP_CALL:{
+        case OP_CALL: case OP_MEMO_RETURN:{
             obj_function_t* p = (obj_function_t*)extracted_value->obj;
             printf(" %p %s(args count: %d) with offset %d[0x%X]\n",
             p, p->base.name->str, p->base.argc, p->entry_offset, p->entry_offset);
             break;
         }
-        case OP_NATIVE_CALL:{
-            obj_natfunction_t* p = (obj_natfunction_t*)extracted_value->obj;
-            printf(" %p %s(args count: %d) [native function]\n",
-            p, p->base.name->str, p->base.argc);
+        case OP_CHECK_TYPE:{
+            int val = *(int*)(chunk->_code.data + offset + 1);
+            printf(" [%s]\n", get_static_type_name(val));
+            break;
+        }
+        case OP_CHECK_ARGS:{
+            obj_function_t* p = (obj_function_t*)extracted_value->obj;
+            printf(" %s(", p->base.name->str);
+            for(int i = 0; i < p->base.argc; i++)
+                printf(i + 1 < p->base.argc ? "%s, " : "%s", get_static_type_name(p->arg_types[i]));
+            printf(")\n");
             break;
         }
+        case OP_SWITCH_TABLE:
+            printf(" keys from %g, table size: %g, default: %g\n",
+            extracted_value[0].number, extracted_value[1].number, extracted_value[2].number);
+            break;
+        case OP_GET_PATH:
+            for(int i = 0; i < extracted_value[0].number; i++)
+                printf(" .%s", ((obj_id_t*)extracted_value[1 + 3 * i].obj)->str);
+            putchar('\n');
+            break;
+        case OP_SWITCH_HASH:
+            printf(" %s keys, table capacity: %g, default: %g\n",
+            extracted_value[2].number ? "string" : "number", extracted_value[0].number, extracted_value[1].number);
+            break;
         default:
             printf(" Not implemented constant instruction :(\n");
     }
@@ -223,10 +445,57 @@ static inline size_t constant_instruction_debug(const char* name, const struct b
     #undef EXTRACTED_VALUE
 }
 
+static inline size_t short_instruction_debug(const char* name, const struct bytecode_chunk* chunk, size_t offset){
+    op_t op = chunk->_code.data[offset];
+    bool is_signed = op == OP_GET_LOCAL_SHORT || op == OP_SET_LOCAL_SHORT;
+    int val = is_signed ? (int8_t)chunk->_code.data[offset + 1] : chunk->_code.data[offset + 1];
+    print_instruction_debug(name, chunk, offset);
+    printf(is_signed ? " stack index: %d\n" : " %d\n", val);
+    return offset + 2;
+}
+
+static inline size_t invoke_instruction_debug(const char* name, const struct bytecode_chunk* chunk, size_t offset){
+    #define EXTRACTED_OBJ(idx) (((union _inner_value_t*)(chunk->_data.data + (*(int*)(chunk->_code.data + offset + 1 + (idx) * sizeof(int)))))->obj)
+
+    obj_class_t* cl = (obj_class_t*)EXTRACTED_OBJ(0);
+    obj_function_t* p = (obj_function_t*)EXTRACTED_OBJ(1);
+    print_instruction_debug(name, chunk, offset);
+    printf(" %s.%s(args count: %d) with offset %d[0x%X]\n",
+    cl->name->str, p->base.name->str, p->base.argc, p->entry_offset, p->entry_offset);
+    return offset + 1 + 2 * sizeof(int);
+    #undef EXTRACTED_OBJ
+}
+
+static inline size_t forloop_instruction_debug(const char* name, const struct bytecode_chunk* chunk, size_t offset){
+    int* operands = (int*)(chunk->_code.data + offset + 1);
+    print_instruction_debug(name, chunk, offset);
+    printf(" counter index: %d limit index: %d jump: %d [0x%X]\n", operands[0], operands[1], operands[2], operands[2]);
+    return offset + 1 + 3 * sizeof(int);
+}
+
+static inline size_t concat_instruction_debug(const char* name, const struct bytecode_chunk* chunk, size_t offset){
+    int* operands = (int*)(chunk->_code.data + offset + 1);
+    print_instruction_debug(name, chunk, offset);
+    printf(" count: %d%s\n", operands[0], operands[1] ? " with conversion" : "");
+    return offset + 1 + 2 * sizeof(int);
+}
+
+static inline size_t native_instruction_debug(const char* name, const struct bytecode_chunk* chunk, size_t offset){
+    int* operands = (int*)(chunk->_code.data + offset + 1);
+    obj_natfunction_t* p = (obj_natfunction_t*)((union _inner_value_t*)(chunk->_data.data + operands[0]))->obj;
+    print_instruction_debug(name, chunk, offset);
+    printf(" %p %s(args count: %d) [native function]\n", p, p->base.name->str, operands[1]);
+    return offset + 1 + 2 * sizeof(int);
+}
+
 void bcchunk_disassemble(const char* chunk_name, const struct bytecode_chunk* chunk){
     printf("=== Disassemble of %s chunk ===\n", chunk_name);
     for(size_t offset = 0; offset < chunk->_code.size;)
         offset = instruction_debug(chunk, offset);
+    const struct exception_handler* handlers = (const struct exception_handler*)chunk->_handlers.data;
+    for(size_t i = 0; i < chunk->_handlers.size / sizeof(struct exception_handler); i++)
+        printf("try [%04X, %04X) -> catch %04X with %d locals\n",
+        (unsigned)handlers[i].start, (unsigned)handlers[i].end, (unsigned)handlers[i].target, handlers[i].depth);
 }
 
 #endif
@@ -239,9 +508,8 @@ int bcchunk_get_codesize(struct bytecode_chunk* chunk){
 }
 
 void bcchunk_write_constant(struct bytecode_chunk* chunk, int num, int line){
+    line_write(chunk, chunk->_code.size, line);
     chunk_write_number(&chunk->_code, num);
-    for(size_t i  = 0; i < sizeof(int); i++)
-        chunk_write_number(&chunk->_line_data, line);
 }
 
 void bcchunk_rewrite_constant(struct bytecode_chunk *chunk, int offset, int num){
@@ -250,10 +518,93 @@ void bcchunk_rewrite_constant(struct bytecode_chunk *chunk, int offset, int num)
 
 //5 bytes in the instruction
 void bcchunk_write_value(struct bytecode_chunk* chunk, value_t data, int line){
-    chunk_write_number(&chunk->_code, chunk->_data.size);
-    for(size_t i  = 0; i < sizeof(int); i++)
-        chunk_write_number(&chunk->_line_data, line);
-    chunk_write_value(&chunk->_data, data);
+    int offset = data_intern_value(chunk, data);
+    line_write(chunk, chunk->_code.size, line);
+    chunk_write_number(&chunk->_code, offset);
+}
+
+static inline bool is_short_operand(int num){
+    return num >= INT8_MIN && num <= INT8_MAX;
+}
+
+void bcchunk_write_local_op(struct bytecode_chunk* chunk, op_t op, int idx, int line){
+    if(op == OP_GET_LOCAL && idx >= 0 && idx <= 3){
+        bcchunk_write_simple_op(chunk, OP_GET_LOCAL_0 + idx, line);
+    }else if((op == OP_GET_LOCAL || op == OP_SET_LOCAL) && is_short_operand(idx)){
+        bcchunk_write_simple_op(chunk, op == OP_GET_LOCAL ? OP_GET_LOCAL_SHORT : OP_SET_LOCAL_SHORT, line);
+        bcchunk_write_code(chunk, (byte_t)(int8_t)idx, line);
+    }else{
+        bcchunk_write_simple_op(chunk, op, line);
+        bcchunk_write_value(chunk, VALUE_NUMBER(idx), line);
+    }
+}
+
+void bcchunk_write_popn(struct bytecode_chunk* chunk, int count, int line){
+    if(count == 1){
+        bcchunk_write_simple_op(chunk, OP_POP, line);
+    }else if(count > 1 && count <= UINT8_MAX){
+        bcchunk_write_simple_op(chunk, OP_POPN_SHORT, line);
+        bcchunk_write_code(chunk, count, line);
+    }else if(count > 1){
+        bcchunk_write_simple_op(chunk, OP_POPN, line);
+        bcchunk_write_constant(chunk, count, line);
+    }
+}
+
+int bcchunk_instruction_size(op_t op){
+    switch(op){
+        case OP_RETURN: case OP_POP: case OP_NONE:
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+        case OP_AND: case OP_OR: case OP_XOR: case OP_NOT:
+        case OP_EQUAL: case OP_GREATER: case OP_LESS:
+        case OP_ADD_NUM: case OP_SUB_NUM: case OP_MUL_NUM: case OP_DIV_NUM:
+        case OP_EQUAL_NUM: case OP_GREATER_NUM: case OP_LESS_NUM:
+        case OP_IS_NUM: case OP_IS_STR: case OP_IS_BOOL: case OP_IS_INST: case OP_IS_NONE: case OP_IS_UNINIT:
+        case OP_SQRT: case OP_FLOOR: case OP_ABS: case OP_MIN: case OP_MAX: case OP_POW:
+        case OP_THROW:
+        case OP_GET_LOCAL_0: case OP_GET_LOCAL_1: case OP_GET_LOCAL_2: case OP_GET_LOCAL_3:
+            return 1;
+        case OP_GET_LOCAL_SHORT: case OP_SET_LOCAL_SHORT: case OP_POPN_SHORT: case OP_CLARGS_SHORT:
+            return 2;
+        case OP_INVOKE: case OP_CONCAT_N: case OP_NATIVE_CALL:
+            return 1 + 2 * sizeof(int);
+        case OP_FORLOOP_LESS: case OP_FORLOOP_ELESS:
+        case OP_FORLOOP_GREATER: case OP_FORLOOP_EGREATER:
+            return 1 + 3 * sizeof(int);
+        default:
+            return 1 + sizeof(int);
+    }
+}
+
+bool bcchunk_is_pure(const struct bytecode_chunk* chunk, int start, const obj_function_t* self){
+    #define EXTRACTED_OBJ(offset) (((union _inner_value_t*)(chunk->_data.data + (*(int*)(chunk->_code.data + (offset) + 1))))->obj)
+
+    for(size_t offset = start; offset < chunk->_code.size; offset += bcchunk_instruction_size(chunk->_code.data[offset])){
+        switch((op_t)chunk->_code.data[offset]){
+            case OP_CALL:{
+                obj_function_t* p = (obj_function_t*)EXTRACTED_OBJ(offset);
+                if(p != self && !p->is_pure)
+                    return false;
+                break;
+            }
+            case OP_NATIVE_CALL:
+                if(!(((obj_natfunction_t*)EXTRACTED_OBJ(offset))->flags & NATIVE_PURE))
+                    return false;
+                break;
+            case OP_SET_GLOBAL: case OP_GET_GLOBAL:
+            case OP_POSTINCR_GLOBAL: case OP_POSTDECR_GLOBAL:
+            case OP_PREFINCR_GLOBAL: case OP_PREFDECR_GLOBAL:
+            case OP_INSTANCE: case OP_GET_FIELD: case OP_SET_FIELD: case OP_GET_PATH:
+            case OP_METHOD: case OP_INVOKE: case OP_THROW:
+            case OP_ADD_ASSIGN_GLOBAL: case OP_SUB_ASSIGN_GLOBAL: case OP_MUL_ASSIGN_GLOBAL: case OP_DIV_ASSIGN_GLOBAL:
+            case OP_ADD_ASSIGN_FIELD: case OP_SUB_ASSIGN_FIELD: case OP_MUL_ASSIGN_FIELD: case OP_DIV_ASSIGN_FIELD:
+                return false;
+            default:
+                break;
+        }
+    }
+    return true;
+    #undef EXTRACTED_OBJ
 }
 
 void bcchunk_write_expression(const ast_node* root, struct bytecode_chunk* chunk, int line){
@@ -263,26 +614,168 @@ void bcchunk_write_expression(const ast_node* root, struct bytecode_chunk* chunk
     parse_ast_bin_expr(root, chunk, line);
 }
 
+int bcchunk_write_condition(const ast_node* root, bool jump_if, struct bytecode_chunk* chunk, int line){
+#ifdef DEBUG
+    ast_debug_tree(root);
+#endif
+    return write_cond_jump(root, jump_if, JUMP_LIST_END, chunk, line);
+}
+
+void bcchunk_patch_jumps(struct bytecode_chunk* chunk, int list, int target){
+    while(list != JUMP_LIST_END){
+        int next = *(int*)(chunk->_code.data + list);
+        bcchunk_rewrite_constant(chunk, list, target - (list + (int)sizeof(int)));
+        list = next;
+    }
+}
+
+bool bcchunk_is_counted_loop(const ast_node* cond, const ast_node* step, op_t* op){
+    if(cond == NULL || step == NULL)
+        return false;
+    bool is_incr = step->type == AST_POSTINCR || step->type == AST_PREFINCR;
+    bool is_decr = step->type == AST_POSTDECR || step->type == AST_PREFDECR;
+    switch(cond->type){
+        case AST_LESS: *op = OP_FORLOOP_LESS; break;
+        case AST_ELESS: *op = OP_FORLOOP_ELESS; break;
+        case AST_GREATER: *op = OP_FORLOOP_GREATER; break;
+        case AST_EGREATER: *op = OP_FORLOOP_EGREATER; break;
+        default: return false;
+    }
+    if((*op == OP_FORLOOP_LESS || *op == OP_FORLOOP_ELESS) ? !is_incr : !is_decr)
+        return false;
+
+    const ast_node* counter = ((struct ast_binary*)cond->data.ptr)->left;
+    const ast_node* limit = ((struct ast_binary*)cond->data.ptr)->right;
+    if(counter->type != AST_IDENT || AS_OBJIDENTIFIER(counter->data.val) != AS_OBJIDENTIFIER(step->data.val)
+        || scope_resolve_slot(AS_OBJIDENTIFIER(counter->data.val)) == -1)
+        return false;
+    if(limit->type == AST_NUMBER)
+        return true;
+    return limit->type == AST_IDENT && AS_OBJIDENTIFIER(limit->data.val) != AS_OBJIDENTIFIER(counter->data.val)
+        && scope_resolve_slot(AS_OBJIDENTIFIER(limit->data.val)) != -1;
+}
+
+void bcchunk_write_counted_loop(op_t op, int counter, int limit, int target, struct bytecode_chunk* chunk, int line){
+    bcchunk_write_simple_op(chunk, op, line);
+    bcchunk_write_constant(chunk, counter, line);
+    bcchunk_write_constant(chunk, limit, line);
+    bcchunk_write_constant(chunk, target - (bcchunk_get_codesize(chunk) + (int)sizeof(int)), line);
+}
+
+void bcchunk_write_switch(struct bytecode_chunk* chunk, int op_offset, const struct switch_case* cases, int count, int default_target){
+    //jumps are relative to the end of the instruction
+    int base = op_offset + 1 + sizeof(int);
+    int table = chunk->_data.size;
+
+    //jump table is indexed by int, other keys go to the hash table
+    bool is_dense = count > 0;
+    int64_t min = 0, max = 0;
+    for(int i = 0; i < count && is_dense; i++){
+        if(!IS_NUMBER(cases[i].key)){
+            is_dense = false;
+            break;
+        }
+        double key = AS_NUMBER(cases[i].key);
+        if(key < INT32_MIN || key > INT32_MAX || key != (int32_t)key){
+            is_dense = false;
+            break;
+        }
+        if(i == 0 || key < min)
+            min = key;
+        if(i == 0 || key > max)
+            max = key;
+    }
+    //table may contain twice as many entries as cases
+    if(is_dense && max - min + 1 > SWITCH_DENSITY * count)
+        is_dense = false;
+
+    if(is_dense){
+        //min key, size, default and jumps for every key in the range
+        int size = (int)(max - min + 1);
+        int* jumps = emalloc(sizeof(int) * size);
+        for(int i = 0; i < size; i++)
+            jumps[i] = default_target - base;
+        for(int i = 0; i < count; i++)
+            jumps[(int32_t)AS_NUMBER(cases[i].key) - min] = cases[i].target - base;
+
+        data_write_value(chunk, VALUE_NUMBER(min));
+        data_write_value(chunk, VALUE_NUMBER(size));
+        data_write_value(chunk, VALUE_NUMBER(default_target - base));
+        for(int i = 0; i < size; i++)
+            data_write_value(chunk, VALUE_NUMBER(jumps[i]));
+        free(jumps);
+        chunk->_code.data[op_offset] = OP_SWITCH_TABLE;
+    }else{
+        //capacity, default, key type and pairs of a key and a jump, empty entries have negative jump
+        bool is_string = count > 0 && IS_OBJSTRING(cases[0].key);
+        int capacity = 2;
+        while(capacity < SWITCH_DENSITY * count)
+            capacity *= 2;
+        struct switch_case* entries = emalloc(sizeof(struct switch_case) * capacity);
+        for(int i = 0; i < capacity; i++)
+            entries[i].target = -1;
+        for(int i = 0; i < count; i++){
+            uint32_t idx = switch_key_hash(cases[i].key.as, is_string) & (capacity - 1);
+            while(entries[idx].target >= 0)
+                idx = (idx + 1) & (capacity - 1);
+            entries[idx].key = cases[i].key;
+            entries[idx].target = cases[i].target - base;
+        }
+
+        data_write_value(chunk, VALUE_NUMBER(capacity));
+        data_write_value(chunk, VALUE_NUMBER(default_target - base));
+        data_write_value(chunk, VALUE_NUMBER(is_string));
+        for(int i = 0; i < capacity; i++){
+            data_write_value(chunk, entries[i].target >= 0 ? entries[i].key : VALUE_NUMBER(0));
+            data_write_value(chunk, VALUE_NUMBER(entries[i].target));
+        }
+        free(entries);
+        chunk->_code.data[op_offset] = OP_SWITCH_HASH;
+    }
+    bcchunk_rewrite_constant(chunk, op_offset + 1, table);
+}
+
+void bcchunk_write_type_check(const ast_node* root, static_type type, struct bytecode_chunk* chunk, int line){
+    if(type == ST_ANY || infer_type(root) == type)
+        return;
+    bcchunk_write_simple_op(chunk, OP_CHECK_TYPE, line);
+    bcchunk_write_constant(chunk, type, line);
+}
+
+void bcchunk_write_argument_check(obj_function_t* func, struct bytecode_chunk* chunk, int line){
+    if(func->arg_types == NULL)
+        return;
+    bcchunk_write_simple_op(chunk, OP_CHECK_ARGS, line);
+    bcchunk_write_value(chunk, VALUE_OBJ(func), line);
+}
+
 static void bcchunk_clear_args(struct bytecode_chunk* chunk, int argc, int line){
-    if(argc > 0){
+    if(argc > 0 && argc <= UINT8_MAX){
+        bcchunk_write_simple_op(chunk, OP_CLARGS_SHORT, line);
+        bcchunk_write_code(chunk, argc, line);
+    }else if(argc > 0){
         bcchunk_write_simple_op(chunk,OP_CLARGS, line);
         bcchunk_write_constant(chunk,argc,line);
     }
 }
 
-static void bcchunk_parse_property(const ast_node* node, bool is_final,struct bytecode_chunk* chunk, int line){
+//receiver is a known class of the instance on the left of the property
+static void bcchunk_parse_property(const ast_node* node, bool is_final, obj_class_t* receiver, struct bytecode_chunk* chunk, int line){
     switch(node->type){
         case AST_IDENT: 
             if(is_final)
                 write_get_var(chunk, (obj_id_t*)AS_OBJ(node->data.val), line);
-            else{
-                bcchunk_write_simple_op(chunk, OP_GET_FIELD,line);
-                bcchunk_write_value(chunk, node->data.val, line);
-            }
+            else
+                bcchunk_write_get_field(chunk, AS_OBJIDENTIFIER(node->data.val), line);
             break;
         case AST_PROPERTY:
-            bcchunk_parse_property(((struct ast_binary*)node->data.ptr)->left, true, chunk, line);
-            bcchunk_parse_property(((struct ast_binary*)node->data.ptr)->right, false, chunk, line);
+            if(((struct ast_binary*)node->data.ptr)->right->type == AST_IDENT){
+                write_field_path(node, chunk, line);
+                break;
+            }
+            bcchunk_parse_property(((struct ast_binary*)node->data.ptr)->left, true, NULL, chunk, line);
+            bcchunk_parse_property(((struct ast_binary*)node->data.ptr)->right, false,
+                bcchunk_infer_class(((struct ast_binary*)node->data.ptr)->left), chunk, line);
             break;
         case AST_CALL:{
             struct ast_call_info* info = node->data.ptr;
@@ -294,7 +787,7 @@ static void bcchunk_parse_property(const ast_node* node, bool is_final,struct by
             if(IS_OBJCLASS(val)){
                 bcchunk_write_constructor(AS_OBJCLASS(val), argc, chunk, line);
             }else {
-                bcchunk_write_method(chunk, info->id, argc,line);
+                bcchunk_write_method(chunk, receiver, info->id, argc,line);
             }
             break;
         }
@@ -312,60 +805,74 @@ static void parse_ast_bin_expr(const ast_node* node, struct bytecode_chunk* chun
         parse_ast_bin_expr(((struct ast_binary*)node->data.ptr)->right, chunk, line);\
         bcchunk_write_simple_op(chunk, op, line);\
     }while(0)
+    //both operands are proven to be numbers
+    #define IS_NUM_OPERANDS() (infer_type(((struct ast_binary*)node->data.ptr)->left) == ST_NUM && \
+        infer_type(((struct ast_binary*)node->data.ptr)->right) == ST_NUM)
+    #define NUM_BIN_OP(op) BIN_OP(IS_NUM_OPERANDS() ? op##_NUM : op)
 
     switch (node->type) {
         case AST_ADD: 
-            BIN_OP(OP_ADD);
+            if(!write_concat(node, chunk, line))
+                NUM_BIN_OP(OP_ADD);
             break;
         case AST_SUB: 
-            BIN_OP(OP_SUB);
+            NUM_BIN_OP(OP_SUB);
             break;
         case AST_MUL: 
-            BIN_OP(OP_MUL);
+            NUM_BIN_OP(OP_MUL);
             break;
         case AST_DIV: 
-            BIN_OP(OP_DIV);
+            NUM_BIN_OP(OP_DIV);
             break;
         case AST_AND:
-            BIN_OP(OP_AND);
-            break;
-        case AST_OR: 
-            BIN_OP(OP_OR);
+        case AST_OR:{
+            //the right operand is evaluated only if the left doesn't decide the result
+            int false_jumps = write_cond_jump(node, false, JUMP_LIST_END, chunk, line);
+            bcchunk_write_simple_op(chunk, OP_BOOLEAN, line);
+            bcchunk_write_value(chunk, VALUE_BOOLEAN(true), line);
+            int end_jump = write_jump(chunk, OP_JUMP, JUMP_LIST_END, line);
+            bcchunk_patch_jumps(chunk, false_jumps, bcchunk_get_codesize(chunk));
+            bcchunk_write_simple_op(chunk, OP_BOOLEAN, line);
+            bcchunk_write_value(chunk, VALUE_BOOLEAN(false), line);
+            bcchunk_patch_jumps(chunk, end_jump, bcchunk_get_codesize(chunk));
             break;
+        }
         case AST_XOR:   
             BIN_OP(OP_XOR);
             break;
         case AST_EQUAL:
-            BIN_OP(OP_EQUAL);
+            NUM_BIN_OP(OP_EQUAL);
             break;
         case AST_NEQUAL:
-            BIN_OP(OP_EQUAL);
+            NUM_BIN_OP(OP_EQUAL);
             bcchunk_write_simple_op(chunk, OP_NOT, line);
             break;
         case AST_EGREATER:
-            BIN_OP(OP_LESS);
+            NUM_BIN_OP(OP_LESS);
             bcchunk_write_simple_op(chunk, OP_NOT,line); 
             break;
         case AST_GREATER:
-            BIN_OP(OP_GREATER);
+            NUM_BIN_OP(OP_GREATER);
             break;
         case AST_ELESS:
-            BIN_OP(OP_GREATER);
+            NUM_BIN_OP(OP_GREATER);
             bcchunk_write_simple_op(chunk, OP_NOT, line); 
             break;
         case AST_LESS:
-            BIN_OP(OP_LESS);
+            NUM_BIN_OP(OP_LESS);
             break;
         case AST_ASSIGN:{
             struct ast_binary* temp = ((struct ast_binary*)node->data.ptr);
             parse_ast_bin_expr(temp->right, chunk, line);
             if(temp->left->type == AST_IDENT && AS_OBJIDENTIFIER(temp->left->data.val) != scope_get_this()){
+                bcchunk_write_type_check(temp->right, scope_get_type(AS_OBJIDENTIFIER(temp->left->data.val)), chunk, line);
+                scope_update_known_class(AS_OBJIDENTIFIER(temp->left->data.val), bcchunk_infer_class(temp->right));
                 write_set_var(chunk, AS_OBJIDENTIFIER(temp->left->data.val), line);
             }else if(temp->left->type == AST_PROPERTY){
                 temp = temp->left->data.ptr;
                 if(!IS_OBJIDENTIFIER(temp->right->data.val))
                     compile_error_printf("Value is not instance, cannot get property\n");
-                bcchunk_parse_property(temp->left, true, chunk, line);
+                bcchunk_parse_property(temp->left, true, NULL, chunk, line);
                 bcchunk_write_simple_op(chunk, OP_SET_FIELD, line);
                 bcchunk_write_value(chunk,temp->right->data.val, line);
             }else{
@@ -373,6 +880,32 @@ static void parse_ast_bin_expr(const ast_node* node, struct bytecode_chunk* chun
             }
             break;
         }
+        case AST_ADD_ASSIGN: case AST_SUB_ASSIGN: case AST_MUL_ASSIGN: case AST_DIV_ASSIGN:{
+            //local, global and field opcodes for every operation
+            static const op_t ops[][3] = {
+                {OP_ADD_ASSIGN_LOCAL, OP_ADD_ASSIGN_GLOBAL, OP_ADD_ASSIGN_FIELD},
+                {OP_SUB_ASSIGN_LOCAL, OP_SUB_ASSIGN_GLOBAL, OP_SUB_ASSIGN_FIELD},
+                {OP_MUL_ASSIGN_LOCAL, OP_MUL_ASSIGN_GLOBAL, OP_MUL_ASSIGN_FIELD},
+                {OP_DIV_ASSIGN_LOCAL, OP_DIV_ASSIGN_GLOBAL, OP_DIV_ASSIGN_FIELD}
+            };
+            const op_t* op = ops[AST_COMPOUND_OP(node->type) - AST_ADD];
+            struct ast_binary* temp = ((struct ast_binary*)node->data.ptr);
+            parse_ast_bin_expr(temp->right, chunk, line);
+            if(temp->left->type == AST_IDENT && AS_OBJIDENTIFIER(temp->left->data.val) != scope_get_this()){
+                scope_update_known_class(AS_OBJIDENTIFIER(temp->left->data.val), NULL);
+                write_compound_assign_var(chunk, AS_OBJIDENTIFIER(temp->left->data.val), op[0], op[1], op[2], line);
+            }else if(temp->left->type == AST_PROPERTY){
+                temp = temp->left->data.ptr;
+                if(!IS_OBJIDENTIFIER(temp->right->data.val))
+                    compile_error_printf("Value is not instance, cannot get property\n");
+                bcchunk_parse_property(temp->left, true, NULL, chunk, line);
+                bcchunk_write_simple_op(chunk, op[2], line);
+                bcchunk_write_value(chunk, temp->right->data.val, line);
+            }else{
+                compile_error_printf("Left operand is not assignable!\n");
+            }
+            break;
+        }
         case AST_NOT:{
             parse_ast_bin_expr(node->data.ptr, chunk, line);
             bcchunk_write_simple_op(chunk, OP_NOT, line);
@@ -410,12 +943,17 @@ static void parse_ast_bin_expr(const ast_node* node, struct bytecode_chunk* chun
             value_t val = extract_callable(info);
             if(IS_OBJIDENTIFIER(val)){
                 if(scope_get_class() != NULL){
-                    bcchunk_write_simple_op(chunk,OP_GET_LOCAL,line);
-                    bcchunk_write_value(chunk, VALUE_NUMBER(0), line);
+                    bcchunk_write_local_op(chunk, OP_GET_LOCAL, 0, line);
                 }else{
                     compile_error_printf("Undefined identifier '%s'\n", AS_OBJIDENTIFIER(val)->str);
                 }
             }
+            value_t result;
+            if(eval_pure_call(info, &result)){
+                bcchunk_write_code(chunk, IS_NUMBER(result) ? OP_NUMBER : IS_BOOLEAN(result) ? OP_BOOLEAN : OP_STRING, line);
+                bcchunk_write_value(chunk, result, line);
+                break;
+            }
             int argc = bcchunk_parse_call_args(info->args, chunk, line);
             op_t op;
             switch(AS_OBJ(val)->type){
@@ -427,17 +965,27 @@ static void parse_ast_bin_expr(const ast_node* node, struct bytecode_chunk* chun
                     op = OP_CALL;
                     break;
                 }
-                case OBJ_NATFUNCTION:
-                    bcchunk_write_code(chunk, OP_NUMBER, line);
-                    bcchunk_write_value(chunk, VALUE_NUMBER(argc), line);
-                    op = OP_NATIVE_CALL;
-                    break;
+                case OBJ_NATFUNCTION:{
+                    obj_natfunction_t* native = AS_OBJNATFUNCTION(val);
+                    if(native->base.argc != NATIVE_VARIADIC && argc != native->base.argc)
+                        compile_error_printf("Expected %d arguments in '%s' function call, found %d\n",
+                        native->base.argc, native->base.name->str, argc);
+                    if(native->intrinsic != -1){
+                        bcchunk_write_simple_op(chunk, native->intrinsic, line);
+                        return;
+                    }
+                    //the native function removes its arguments itself
+                    bcchunk_write_simple_op(chunk, OP_NATIVE_CALL, line);
+                    bcchunk_write_value(chunk, val, line);
+                    bcchunk_write_constant(chunk, argc, line);
+                    return;
+                }
                 case OBJ_CLASS:{
                     bcchunk_write_constructor(AS_OBJCLASS(val),argc, chunk, line);
                     return;
                 }
                 case OBJ_IDENTIFIER:{
-                    bcchunk_write_method(chunk, AS_OBJIDENTIFIER(val), argc, line);
+                    bcchunk_write_method(chunk, scope_get_class(), AS_OBJIDENTIFIER(val), argc, line);
                     return;
                 }
                 default:
@@ -449,7 +997,14 @@ static void parse_ast_bin_expr(const ast_node* node, struct bytecode_chunk* chun
             break;
         }
         case AST_PROPERTY:{
-            bcchunk_parse_property(node, true, chunk, line);
+            bcchunk_parse_property(node, true, NULL, chunk, line);
+            break;
+        }
+        case AST_INTERP:{
+            int count = write_interp_parts(node->data.ptr, chunk, line);
+            bcchunk_write_simple_op(chunk, OP_CONCAT_N, line);
+            bcchunk_write_constant(chunk, count, line);
+            bcchunk_write_constant(chunk, true, line);
             break;
         }
         default:
@@ -457,6 +1012,168 @@ static void parse_ast_bin_expr(const ast_node* node, struct bytecode_chunk* chun
     }
 
     #undef BIN_OP
+    #undef IS_NUM_OPERANDS
+    #undef NUM_BIN_OP
+}
+
+void bcchunk_write_get_field(struct bytecode_chunk* chunk, obj_id_t* field, int line){
+    obj_class_t* cl = profile_next_site(PROFILE_FIELD_SITE);
+    value_t idx;
+    if(cl == NULL || !table_check(cl->fields, field, &idx)){
+        bcchunk_write_simple_op(chunk, OP_GET_FIELD, line);
+        bcchunk_write_value(chunk, VALUE_OBJ(field), line);
+        return;
+    }
+    //a path of one hop with the cache filled in advance
+    bcchunk_write_simple_op(chunk, OP_GET_PATH, line);
+    bcchunk_write_constant(chunk, chunk->_data.size, line);
+    data_write_value(chunk, VALUE_NUMBER(1));
+    data_write_value(chunk, VALUE_OBJ(field));
+    data_write_value(chunk, VALUE_OBJ(cl));
+    data_write_value(chunk, VALUE_NUMBER(AS_NUMBER(idx)));
+}
+
+static void write_field_path(const ast_node* node, struct bytecode_chunk* chunk, int line){
+    //fields are collected from the end of the chain
+    obj_id_t* hops[PATH_LENGTH_LIMIT];
+    int count = 0;
+    for(; count < PATH_LENGTH_LIMIT && node->type == AST_PROPERTY &&
+    ((struct ast_binary*)node->data.ptr)->right->type == AST_IDENT; node = ((struct ast_binary*)node->data.ptr)->left)
+        hops[count++] = AS_OBJIDENTIFIER(((struct ast_binary*)node->data.ptr)->right->data.val);
+
+    //a field of the current class starts the path from 'this'
+    if(count < PATH_LENGTH_LIMIT && node->type == AST_IDENT && scope_is_field(AS_OBJIDENTIFIER(node->data.val))){
+        hops[count++] = AS_OBJIDENTIFIER(node->data.val);
+        write_get_var(chunk, scope_get_this(), line);
+    }else{
+        bcchunk_parse_property(node, true, NULL, chunk, line);
+    }
+
+    if(count == 1){
+        bcchunk_write_get_field(chunk, hops[0], line);
+        return;
+    }
+    bcchunk_write_simple_op(chunk, OP_GET_PATH, line);
+    bcchunk_write_constant(chunk, chunk->_data.size, line);
+    data_write_value(chunk, VALUE_NUMBER(count));
+    for(int i = count - 1; i >= 0; i--){
+        data_write_value(chunk, VALUE_OBJ(hops[i]));
+        data_write_value(chunk, VALUE_OBJ(NULL));
+        data_write_value(chunk, VALUE_NUMBER(0));
+    }
+}
+
+static bool write_concat(const ast_node* node, struct bytecode_chunk* chunk, int line){
+    //two operands are handled by OP_ADD
+    int count = 0;
+    if(!has_string_operand(node, &count) || count < 3)
+        return false;
+    write_concat_operands(node, chunk, line);
+    bcchunk_write_simple_op(chunk, OP_CONCAT_N, line);
+    bcchunk_write_constant(chunk, count, line);
+    bcchunk_write_constant(chunk, false, line);
+    return true;
+}
+
+//operands are taken only from the left side, so the order of additions is kept
+static bool has_string_operand(const ast_node* node, int* count){
+    bool res = false;
+    for(; node->type == AST_ADD; node = ((struct ast_binary*)node->data.ptr)->left){
+        res = res || infer_type(((struct ast_binary*)node->data.ptr)->right) == ST_STR;
+        (*count)++;
+    }
+    (*count)++;
+    return res || infer_type(node) == ST_STR;
+}
+
+static int write_concat_operands(const ast_node* node, struct bytecode_chunk* chunk, int line){
+    if(node->type != AST_ADD){
+        parse_ast_bin_expr(node, chunk, line);
+        return 1;
+    }
+    int count = write_concat_operands(((struct ast_binary*)node->data.ptr)->left, chunk, line);
+    parse_ast_bin_expr(((struct ast_binary*)node->data.ptr)->right, chunk, line);
+    return count + 1;
+}
+
+//parts are stored in reverse order
+static int write_interp_parts(const struct ast_call_arg* p, struct bytecode_chunk* chunk, int line){
+    if(p == NULL)
+        return 0;
+    int count = write_interp_parts(p->next, chunk, line);
+    parse_ast_bin_expr(p->arg, chunk, line);
+    return count + 1;
+}
+
+obj_class_t* bcchunk_infer_class(const ast_node* root){
+    switch(root->type){
+        case AST_IDENT:
+            return scope_get_known_class(AS_OBJIDENTIFIER(root->data.val));
+        case AST_CALL:{
+            value_t val;
+            if(symtable_get(((struct ast_call_info*)root->data.ptr)->id, &val) && IS_OBJCLASS(val))
+                return AS_OBJCLASS(val);
+            return NULL;
+        }
+        case AST_ASSIGN:
+            return bcchunk_infer_class(((struct ast_binary*)root->data.ptr)->right);
+        default:
+            return NULL;
+    }
+}
+
+static static_type infer_type(const ast_node* node){
+    #define LEFT_TYPE() infer_type(((struct ast_binary*)node->data.ptr)->left)
+    #define RIGHT_TYPE() infer_type(((struct ast_binary*)node->data.ptr)->right)
+
+    switch(node->type){
+        case AST_NUMBER: return ST_NUM;
+        case AST_BOOLEAN: return ST_BOOL;
+        case AST_STRING: return ST_STR;
+        case AST_IDENT: return scope_get_type(AS_OBJIDENTIFIER(node->data.val));
+        case AST_ADD:{
+            static_type left = LEFT_TYPE();
+            return (left == ST_NUM || left == ST_STR) && left == RIGHT_TYPE() ? left : ST_ANY;
+        }
+        case AST_SUB: case AST_MUL: case AST_DIV:
+            return LEFT_TYPE() == ST_NUM && RIGHT_TYPE() == ST_NUM ? ST_NUM : ST_ANY;
+        //these operations either produce a boolean or fail
+        case AST_AND: case AST_OR: case AST_XOR: case AST_NOT:
+        case AST_EQUAL: case AST_NEQUAL: case AST_GREATER:
+        case AST_EGREATER: case AST_LESS: case AST_ELESS:
+            return ST_BOOL;
+        case AST_POSTINCR: case AST_PREFINCR: case AST_POSTDECR: case AST_PREFDECR:
+            return ST_NUM;
+        case AST_INTERP:
+            return ST_STR;
+        case AST_CALL:{
+            //intrinsics either produce the known type or fail
+            value_t val;
+            if(!symtable_get(((struct ast_call_info*)node->data.ptr)->id, &val) ||
+            !IS_OBJNATFUNCTION(val) || AS_OBJNATFUNCTION(val)->intrinsic == -1)
+                return ST_ANY;
+            switch(AS_OBJNATFUNCTION(val)->intrinsic){
+                case OP_IS_NUM: case OP_IS_STR: case OP_IS_BOOL:
+                case OP_IS_INST: case OP_IS_NONE: case OP_IS_UNINIT:
+                    return ST_BOOL;
+                default:
+                    return ST_NUM;
+            }
+        }
+        case AST_ASSIGN:
+            return RIGHT_TYPE();
+        case AST_ADD_ASSIGN:{
+            static_type left = LEFT_TYPE();
+            return (left == ST_NUM || left == ST_STR) && left == RIGHT_TYPE() ? left : ST_ANY;
+        }
+        case AST_SUB_ASSIGN: case AST_MUL_ASSIGN: case AST_DIV_ASSIGN:
+            return LEFT_TYPE() == ST_NUM && RIGHT_TYPE() == ST_NUM ? ST_NUM : ST_ANY;
+        default:
+            return ST_ANY;
+    }
+
+    #undef LEFT_TYPE
+    #undef RIGHT_TYPE
 }
 
 static int bcchunk_parse_call_args(struct ast_call_arg* p, struct bytecode_chunk* chunk, int line){
@@ -469,6 +1186,96 @@ static int bcchunk_parse_call_args(struct ast_call_arg* p, struct bytecode_chunk
     return argc;
 }
 
+static bool eval_constant(const ast_node* node, value_t* val){
+    switch(node->type){
+        case AST_NUMBER:
+        case AST_BOOLEAN:
+        case AST_STRING:
+            *val = node->data.val;
+            return true;
+        case AST_CALL:
+            return eval_pure_call(node->data.ptr, val);
+        default:
+            return false;
+    }
+}
+
+//result is a number, a boolean or a string
+static bool eval_pure_call(const struct ast_call_info* info, value_t* result){
+    value_t val;
+    if(!symtable_get(info->id, &val))
+        return false;
+    bool is_native = IS_OBJNATFUNCTION(val);
+    if(is_native){
+        int flags = AS_OBJNATFUNCTION(val)->flags;
+        if(!(flags & NATIVE_PURE) || (flags & NATIVE_ALLOCATES))
+            return false;
+    }
+    else if(!IS_OBJFUNCTION(val) || !AS_OBJFUNCTION(val)->is_pure)
+        return false;
+    int expected = AS_OBJFUNCBASE(val)->argc;
+    value_t argv[ARGUMENTS_COUNT];
+    int argc = 0;
+    for(struct ast_call_arg* p = info->args; p; p = p->next)
+        argc++;
+    if(expected != NATIVE_VARIADIC && argc != expected)
+        return false;
+    //arguments are stored in reverse order
+    int i = argc;
+    for(struct ast_call_arg* p = info->args; p; p = p->next)
+        if(!eval_constant(p->arg, &argv[--i]))
+            return false;
+    if(is_native ? !vm_eval_native(AS_OBJNATFUNCTION(val), argc, argv, result) : !vm_eval_call(AS_OBJFUNCTION(val), argc, argv, result))
+        return false;
+    return IS_NUMBER(*result) || IS_BOOLEAN(*result) || IS_OBJSTRING(*result);
+}
+
+//returns a new head of the list
+static int write_jump(struct bytecode_chunk* chunk, op_t op, int list, int line){
+    bcchunk_write_simple_op(chunk, op, line);
+    int offset = bcchunk_get_codesize(chunk);
+    bcchunk_write_constant(chunk, list, line);
+    return offset;
+}
+
+static int write_cond_jump(const ast_node* node, bool jump_if, int list, struct bytecode_chunk* chunk, int line){
+    switch(node->type){
+        case AST_BOOLEAN:
+            //constant condition either always jumps or never
+            if(AS_BOOLEAN(node->data.val) == jump_if)
+                list = write_jump(chunk, OP_JUMP, list, line);
+            return list;
+        case AST_NOT:
+            return write_cond_jump(node->data.ptr, !jump_if, list, chunk, line);
+        case AST_AND:
+        case AST_OR:{
+            struct ast_binary* temp = node->data.ptr;
+            //the left operand decides the result if it is false for 'and' and true for 'or'
+            bool decides = node->type == AST_OR;
+            if(decides == jump_if){
+                list = write_cond_jump(temp->left, jump_if, list, chunk, line);
+                return write_cond_jump(temp->right, jump_if, list, chunk, line);
+            }
+            int skip = write_cond_jump(temp->left, decides, JUMP_LIST_END, chunk, line);
+            list = write_cond_jump(temp->right, jump_if, list, chunk, line);
+            bcchunk_patch_jumps(chunk, skip, bcchunk_get_codesize(chunk));
+            return list;
+        }
+        case AST_NEQUAL:
+        case AST_EGREATER:
+        case AST_ELESS:{
+            //compare without OP_NOT and invert the jump
+            ast_node inverted = *node;
+            inverted.type = node->type == AST_NEQUAL ? AST_EQUAL : node->type == AST_EGREATER ? AST_LESS : AST_GREATER;
+            parse_ast_bin_expr(&inverted, chunk, line);
+            return write_jump(chunk, jump_if ? OP_FJUMP : OP_TJUMP, list, line);
+        }
+        default:
+            parse_ast_bin_expr(node, chunk, line);
+            return write_jump(chunk, jump_if ? OP_TJUMP : OP_FJUMP, list, line);
+    }
+}
+
 static value_t extract_callable(struct ast_call_info* info){
     value_t val;
     if(!symtable_get(info->id, &val) || IS_NONE(val)){
@@ -513,6 +1320,42 @@ const char* op_to_string(op_t op){
         [OP_CALL] = "OP_CALL",
         [OP_METHOD] = "OP_METHOD",
         [OP_NATIVE_CALL] = "OP_NATIVE_CALL",
+        [OP_CONCAT_N] = "OP_CONCAT_N",
+        [OP_GET_PATH] = "OP_GET_PATH",
+        [OP_IS_NUM] = "OP_IS_NUM",
+        [OP_IS_STR] = "OP_IS_STR",
+        [OP_IS_BOOL] = "OP_IS_BOOL",
+        [OP_IS_INST] = "OP_IS_INST",
+        [OP_IS_NONE] = "OP_IS_NONE",
+        [OP_IS_UNINIT] = "OP_IS_UNINIT",
+        [OP_SQRT] = "OP_SQRT",
+        [OP_FLOOR] = "OP_FLOOR",
+        [OP_ABS] = "OP_ABS",
+        [OP_MIN] = "OP_MIN",
+        [OP_MAX] = "OP_MAX",
+        [OP_POW] = "OP_POW",
+        [OP_THROW] = "OP_THROW",
+        [OP_MEMO_RETURN] = "OP_MEMO_RETURN",
+        [OP_GET_LOCAL_0] = "OP_GET_LOCAL_0",
+        [OP_GET_LOCAL_1] = "OP_GET_LOCAL_1",
+        [OP_GET_LOCAL_2] = "OP_GET_LOCAL_2",
+        [OP_GET_LOCAL_3] = "OP_GET_LOCAL_3",
+        [OP_GET_LOCAL_SHORT] = "OP_GET_LOCAL_SHORT",
+        [OP_SET_LOCAL_SHORT] = "OP_SET_LOCAL_SHORT",
+        [OP_POPN_SHORT] = "OP_POPN_SHORT",
+        [OP_CLARGS_SHORT] = "OP_CLARGS_SHORT",
+        [OP_ADD_ASSIGN_LOCAL] = "OP_ADD_ASSIGN_LOCAL",
+        [OP_SUB_ASSIGN_LOCAL] = "OP_SUB_ASSIGN_LOCAL",
+        [OP_MUL_ASSIGN_LOCAL] = "OP_MUL_ASSIGN_LOCAL",
+        [OP_DIV_ASSIGN_LOCAL] = "OP_DIV_ASSIGN_LOCAL",
+        [OP_ADD_ASSIGN_GLOBAL] = "OP_ADD_ASSIGN_GLOBAL",
+        [OP_SUB_ASSIGN_GLOBAL] = "OP_SUB_ASSIGN_GLOBAL",
+        [OP_MUL_ASSIGN_GLOBAL] = "OP_MUL_ASSIGN_GLOBAL",
+        [OP_DIV_ASSIGN_GLOBAL] = "OP_DIV_ASSIGN_GLOBAL",
+        [OP_ADD_ASSIGN_FIELD] = "OP_ADD_ASSIGN_FIELD",
+        [OP_SUB_ASSIGN_FIELD] = "OP_SUB_ASSIGN_FIELD",
+        [OP_MUL_ASSIGN_FIELD] = "OP_MUL_ASSIGN_FIELD",
+        [OP_DIV_ASSIGN_FIELD] = "OP_DIV_ASSIGN_FIELD",
         [OP_PREFINCR_GLOBAL] = "OP_PREFINCR_GLOBAL",
         [OP_PREFINCR_LOCAL] = "OP_PREFINCR_LOCAL",
         [OP_PREFDECR_GLOBAL] = "OP_PREFDECR_GLOBAL",
@@ -522,7 +1365,24 @@ const char* op_to_string(op_t op){
         [OP_POSTDECR_GLOBAL] = "OP_POSTDECR_GLOBAL",
         [OP_POSTDECR_LOCAL] = "OP_POSTDECR_LOCAL",
         [OP_INSTANCE] = "OP_INSTANCE",
-        [OP_CLARGS] = "OP_CLARGS"
+        [OP_CLARGS] = "OP_CLARGS",
+        [OP_ADD_NUM] = "OP_ADD_NUM",
+        [OP_SUB_NUM] = "OP_SUB_NUM",
+        [OP_MUL_NUM] = "OP_MUL_NUM",
+        [OP_DIV_NUM] = "OP_DIV_NUM",
+        [OP_EQUAL_NUM] = "OP_EQUAL_NUM",
+        [OP_GREATER_NUM] = "OP_GREATER_NUM",
+        [OP_LESS_NUM] = "OP_LESS_NUM",
+        [OP_CHECK_TYPE] = "OP_CHECK_TYPE",
+        [OP_CHECK_ARGS] = "OP_CHECK_ARGS",
+        [OP_INVOKE] = "OP_INVOKE",
+        [OP_TJUMP] = "OP_TJUMP",
+        [OP_FORLOOP_LESS] = "OP_FORLOOP_LESS",
+        [OP_FORLOOP_ELESS] = "OP_FORLOOP_ELESS",
+        [OP_FORLOOP_GREATER] = "OP_FORLOOP_GREATER",
+        [OP_FORLOOP_EGREATER] = "OP_FORLOOP_EGREATER",
+        [OP_SWITCH_TABLE] = "OP_SWITCH_TABLE",
+        [OP_SWITCH_HASH] = "OP_SWITCH_HASH"
     };
 #ifdef DEBUG 
     if(!(0 <= op && op < sizeof(ops) / sizeof(ops[0])))
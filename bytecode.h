@@ -1,6 +1,7 @@
 #ifndef BYTECODE_H
 #define BYTECODE_H
 
+#include <string.h>
 #include "lang_types.h"
 
 #define CHUNK_BASE_CAPACITY (1024)
@@ -63,19 +64,140 @@ typedef enum{
 
     OP_GET_FIELD,
     OP_SET_FIELD,
-    OP_METHOD
+    OP_METHOD,
+
+    //specialized binary ops for operands that are known to be numbers
+    OP_ADD_NUM,
+    OP_SUB_NUM,
+    OP_MUL_NUM,
+    OP_DIV_NUM,
+    OP_EQUAL_NUM,
+    OP_GREATER_NUM,
+    OP_LESS_NUM,
+    //reads constant static_type and checks the top value on the stack
+    OP_CHECK_TYPE,
+    //reads obj_function_t* and checks its annotated arguments
+    OP_CHECK_ARGS,
+    //reads obj_class_t* and obj_function_t*, calls the method directly
+    //if the instance belongs to the class, otherwise looks it up by name
+    OP_INVOKE,
+    OP_TJUMP, //jump if a top value on the stack is true
+    //read counter index, limit index and jump constants
+    //increment(decrement) the counter and jump back if it is still in the limit
+    OP_FORLOOP_LESS,
+    OP_FORLOOP_ELESS,
+    OP_FORLOOP_GREATER,
+    OP_FORLOOP_EGREATER,
+    //read index of a switch table in _data section
+    //pop the value and jump to the matching case or to default
+    OP_SWITCH_TABLE, //dense integer cases, the value is an index in the table
+    OP_SWITCH_HASH,  //sparse integer or string cases, open addressing hash table
+    //compound assignment, constant value is the same as in OP_*_LOCAL, OP_*_GLOBAL and OP_SET_FIELD
+    //pop the right operand, perform the operation with the variable, store and push the result
+    OP_ADD_ASSIGN_LOCAL,
+    OP_SUB_ASSIGN_LOCAL,
+    OP_MUL_ASSIGN_LOCAL,
+    OP_DIV_ASSIGN_LOCAL,
+    OP_ADD_ASSIGN_GLOBAL,
+    OP_SUB_ASSIGN_GLOBAL,
+    OP_MUL_ASSIGN_GLOBAL,
+    OP_DIV_ASSIGN_GLOBAL,
+    //the instance is on the top of the stack and the right operand is below it
+    OP_ADD_ASSIGN_FIELD,
+    OP_SUB_ASSIGN_FIELD,
+    OP_MUL_ASSIGN_FIELD,
+    OP_DIV_ASSIGN_FIELD,
+    //read count and convert constants
+    //pop count values and push their concatenation, if convert is set numbers and booleans are converted to strings
+    //if not all of them are strings, they are added one by one like OP_ADD does
+    OP_CONCAT_N,
+    //read index of a path table in _data section: count of fields and
+    //field name, cached class and cached field index for every field
+    //pop the instance and push the value of the last field in the path
+    OP_GET_PATH,
+    //intrinsics of built-in functions, simple ops
+    //pop arguments(the first one is on the top) and push the result
+    OP_IS_NUM,
+    OP_IS_STR,
+    OP_IS_BOOL,
+    OP_IS_INST,
+    OP_IS_NONE,
+    OP_IS_UNINIT,
+    OP_SQRT,
+    OP_FLOOR,
+    OP_ABS,
+    OP_MIN,
+    OP_MAX,
+    OP_POW,
+    //simple operation, pops the value and throws it
+    //the handler is looked up in _handlers, the code without throws doesn't execute anything for try blocks
+    OP_THROW,
+    //the same as OP_RETURN, reads index of obj_function_t* in _data section
+    //and stores the result in its cache of 'memo func' before returning
+    OP_MEMO_RETURN,
+    //compact forms are written instead of the ops with 4-byte operands above if the operand fits in a byte
+    //push the local by its index in the frame, no operands
+    OP_GET_LOCAL_0,
+    OP_GET_LOCAL_1,
+    OP_GET_LOCAL_2,
+    OP_GET_LOCAL_3,
+    //read signed byte index of the local in the frame, arguments are negative
+    OP_GET_LOCAL_SHORT,
+    OP_SET_LOCAL_SHORT,
+    //read unsigned byte count, the same as OP_POPN and OP_CLARGS
+    OP_POPN_SHORT,
+    OP_CLARGS_SHORT,
+    //count of instructions, new instructions are added above
+    OP_COUNT
 } op_t;
 
 struct chunk{
-    size_t capacity;
+    size_t capacity; //0 if data is mapped from the image and is not owned by the chunk
     size_t size;
     byte_t* data;
 };
 
+//constant in _data section, bits are the number, the boolean or the pointer
+struct constant_entry{
+    uint64_t bits;
+    value_type type;
+    int offset; //-1 if the entry is empty
+};
+
+//open addressing index of constants written by bcchunk_write_value(),
+//it is used only while the chunk is compiled
+struct constant_index{
+    struct constant_entry* entries;
+    size_t count;
+    size_t capacity;
+};
+
 struct bytecode_chunk{
     struct chunk _code;
-    struct chunk _line_data;
+    struct chunk _line_data; //array of struct line_run sorted by offset
     struct chunk _data;
+    struct chunk _handlers; //array of struct exception_handler
+    struct chunk _relocations; //array of int offsets in _data section that hold obj_t*
+    struct constant_index _constants;
+    //mapped cache file that sections may point to, NULL if there is no such
+    void* image;
+    size_t image_size;
+};
+
+//the code from offset to the offset of the next run is on the line,
+//a run is added only when the line changes
+struct line_run{
+    int offset;
+    int line;
+};
+
+//try block is added when its code is written,
+//so inner blocks precede outer ones in the table
+struct exception_handler{
+    int start;  //offset of the first instruction of the try block
+    int end;    //offset after the last instruction of the try block
+    int target; //offset of the catch block
+    int depth;  //count of the locals in the frame, the exception becomes the next one
 };
 
 //initialize chunk with base capacity
@@ -95,8 +217,67 @@ int bcchunk_get_codesize(struct bytecode_chunk* chunk);
 void bcchunk_write_simple_op(struct bytecode_chunk* chunk, op_t op, int line);
 void bcchunk_write_constant(struct bytecode_chunk* chunk, int num, int line);
 void bcchunk_rewrite_constant(struct bytecode_chunk* chunk,int offset, int num);
+//equal constants share one slot in _data section, so the slot must not be changed at run time
 void bcchunk_write_value(struct bytecode_chunk* chunk, value_t data, int line);
+//writes the shortest form of OP_GET_LOCAL or OP_SET_LOCAL, other local ops are written with the index in _data section
+void bcchunk_write_local_op(struct bytecode_chunk* chunk, op_t op, int idx, int line);
+//writes the shortest instruction that pops count values
+void bcchunk_write_popn(struct bytecode_chunk* chunk, int count, int line);
 void bcchunk_write_expression(const struct ast_node* root, struct bytecode_chunk* chunk, int line);
+//writes OP_CHECK_TYPE if type of the expression is not proven to be 'type'
+void bcchunk_write_type_check(const struct ast_node* root, static_type type, struct bytecode_chunk* chunk, int line);
+//operand of every jump in the list that is not patched yet
+//contains an offset of the previous jump operand in the list
+#define JUMP_LIST_END (-1)
+//writes jumps that are performed if the condition is equal to jump_if
+//'and', 'or' and 'not' are compiled to jumps without computing the boolean value
+//returns a list of jumps that must be patched with bcchunk_patch_jumps()
+int bcchunk_write_condition(const struct ast_node* root, bool jump_if, struct bytecode_chunk* chunk, int line);
+//sets the target offset to all jumps in the list
+void bcchunk_patch_jumps(struct bytecode_chunk* chunk, int list, int target);
+//checks if the loop is 'for(...; i < n; i++)' or 'for(...; i > n; i--)'
+//where 'i' is a local, and 'n' is a local or a number
+//op is set to OP_FORLOOP_* that replaces the step and the condition
+bool bcchunk_is_counted_loop(const struct ast_node* cond, const struct ast_node* step, op_t* op);
+void bcchunk_write_counted_loop(op_t op, int counter, int limit, int target, struct bytecode_chunk* chunk, int line);
+//keys of switch tables are numbers or interned strings
+//a number is hashed by all bits of the double, so any value can be looked up
+static inline uint32_t switch_key_hash(union _inner_value_t key, bool is_string){
+    if(is_string)
+        return (uint32_t)((obj_string_t*)key.obj)->hash;
+    double num = key.number == 0 ? 0 : key.number; //-0 == 0
+    uint64_t bits;
+    memcpy(&bits, &num, sizeof(num));
+    bits = (bits ^ (bits >> 33)) * 0xFF51AFD7ED558CCDull;
+    return (uint32_t)(bits ^ (bits >> 33));
+}
+
+struct switch_case{
+    value_t key; //a number or an interned string
+    int target;  //offset of the case body
+};
+//op_offset is an offset of OP_SWITCH_TABLE written with a constant placeholder
+//chooses the kind of table, writes the table in _data section and patches the instruction
+void bcchunk_write_switch(struct bytecode_chunk* chunk, int op_offset, const struct switch_case* cases, int count, int default_target);
+//return class of the instance if the expression is known to produce it
+obj_class_t* bcchunk_infer_class(const struct ast_node* root);
+//reads the field of the instance on the stack, the site is cached by the class from the profile
+void bcchunk_write_get_field(struct bytecode_chunk* chunk, obj_id_t* field, int line);
+//writes OP_CHECK_ARGS if function has annotated arguments
+void bcchunk_write_argument_check(obj_function_t* func, struct bytecode_chunk* chunk, int line);
+
+void bcchunk_add_handler(struct bytecode_chunk* chunk, const struct exception_handler* handler);
+//return the innermost handler of the try block that contains the offset, NULL if there is no such block
+const struct exception_handler* bcchunk_find_handler(const struct bytecode_chunk* chunk, int offset);
+
+//return line of the code byte by binary search in _line_data, 0 if the chunk is empty
+int bcchunk_get_line(const struct bytecode_chunk* chunk, int offset);
+
+//size of the instruction with its operands in bytes
+int bcchunk_instruction_size(op_t op);
+//checks that the code from start to the end of the chunk has no side effects
+//and doesn't depend on globals, self is a function that is being checked
+bool bcchunk_is_pure(const struct bytecode_chunk* chunk, int start, const obj_function_t* self);
 
 //for debug purposes
 void bcchunk_disassemble(const char* chunk_name, const struct bytecode_chunk* chunk);
@@ -1,5 +1,6 @@
 #include "cycler.h"
 #include "bytecode.h"
+#include "scope.h"
 #include "utils.h"
 #include <stdlib.h>
 
@@ -18,6 +19,7 @@ typedef struct stat_info{
 typedef struct cycle_head{
     int infos;
     int cycle_start;
+    int locals_base; //locals count at the start of the loop body
     struct stat_info* root;
     struct cycle_head* next;
 }cycle_head;
@@ -41,6 +43,8 @@ static void free_cycle_head(cycle_head* ptr, struct bytecode_chunk* chunk);
 static void add_break_info(cycle_head* ptr, int offset);
 static void add_cont_info(cycle_head* ptr, int offset);
 static void add_info(cycle_head* ptr, int offset, stat_info*(mk_info)(int));
+//pop locals of the loop body before leaving it
+static void pop_body_locals(struct bytecode_chunk* chunk, int line);
 
 bool is_cycle(){
     return cycler.cycle_depth > 0;
@@ -55,6 +59,7 @@ void start_parse_cycle(struct bytecode_chunk* chunk){
 }
 //mark jump operation
 void parse_break(struct bytecode_chunk* chunk, op_t op, int line){
+    pop_body_locals(chunk, line);
     bcchunk_write_simple_op(chunk, op, line);
     int offset = bcchunk_get_codesize(chunk);
     bcchunk_write_constant(chunk, -(int)sizeof(int), line);
@@ -62,6 +67,7 @@ void parse_break(struct bytecode_chunk* chunk, op_t op, int line){
 }
 
 void parse_continue(struct bytecode_chunk* chunk, op_t op, int line){
+    pop_body_locals(chunk, line);
     bcchunk_write_simple_op(chunk, op, line);
     int offset = bcchunk_get_codesize(chunk);
     bcchunk_write_constant(chunk, -(int)sizeof(int), line);
@@ -72,6 +78,14 @@ void change_start_offset(int offset){
     cycler.root->cycle_start = offset;
 }
 
+void start_cycle_body(){
+    cycler.root->locals_base = scope_get_locals_count();
+}
+
+static void pop_body_locals(struct bytecode_chunk* chunk, int line){
+    bcchunk_write_popn(chunk, scope_get_locals_count() - cycler.root->locals_base, line);
+}
+
 //update jump operation constants
 void end_parse_cycle(struct bytecode_chunk* chunk){
     cycler.cycle_depth--;
@@ -86,6 +100,7 @@ static cycle_head* mk_cycle_head(int start){
     ptr->next = NULL;
     ptr->root = NULL;
     ptr->cycle_start = start;
+    ptr->locals_base = scope_get_locals_count();
     return ptr;
 }
 
@@ -14,6 +14,8 @@ void parse_break(struct bytecode_chunk* chunk, op_t op, int line);
 void parse_continue(struct bytecode_chunk* chunk, op_t op, int line);
 //change where to jump after 'continue'
 void change_start_offset(int offset);
+//locals defined after this point are popped before 'break' and 'continue'
+void start_cycle_body();
 
 //update jump operation constants
 void end_parse_cycle(struct bytecode_chunk* chunk);
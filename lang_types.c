@@ -6,6 +6,7 @@
 #include "garbage_collector.h"
 #include "symtable.h"
 #include "hash_table.h"
+#include "memo.h"
 
 static void add_entries(struct obj_class_t* dst_cl, const struct obj_class_t* src_cl){
     struct hash_table* dst = dst_cl->methods;
@@ -63,6 +64,12 @@ obj_function_t* mk_objfunc(obj_string_t* name){
     ptr->base.name = name;
     ptr->base.argc = 0;
     ptr->entry_offset = -1;
+    ptr->arg_types = NULL;
+    ptr->is_pure = false;
+    ptr->memo = NULL;
+    ptr->source_offset = -1;
+    ptr->source_line = 0;
+    ptr->calls = 0;
     ptr->base.obj.type = OBJ_FUNCTION;
     ptr->base.obj.next = NULL;
     ptr->base.obj.is_marked = false;
@@ -70,10 +77,12 @@ obj_function_t* mk_objfunc(obj_string_t* name){
     return ptr;
 }
 
-obj_natfunction_t* mk_objnatfunc(obj_string_t* name, native_function impl){
+obj_natfunction_t* mk_objnatfunc(obj_string_t* name, native_function impl, int argc, int flags){
     obj_natfunction_t* ptr = emalloc(sizeof(obj_natfunction_t));
     ptr->impl = impl;
-    ptr->base.argc = 0;
+    ptr->flags = flags;
+    ptr->intrinsic = -1;
+    ptr->base.argc = argc;
     ptr->base.name = name;
     ptr->base.obj.next = NULL;
     ptr->base.obj.type = OBJ_NATFUNCTION;
@@ -111,20 +120,42 @@ obj_instance_t* mk_objinstance(obj_class_t* cl){
 }
 
 obj_string_t* objstring_conc(value_t a, value_t b){
-    obj_string_t* s1 = AS_OBJSTRING(a);
-    obj_string_t* s2 = AS_OBJSTRING(b);
-    size_t len = s1->len + s2->len;
-    char* s = emalloc(len + 1);
-    strncpy(s, s1->str, s1->len);
-    strncpy(s + s1->len, s2->str, s2->len);
-    s[len] = '\0';
-    int32_t hash = hash_string(s, len);
+    value_t strs[] = {a, b};
+    return objstring_conc_n(strs, 2);
+}
 
-    obj_string_t* ptr = stringtable_findstr(s, len, hash);
-    if(ptr == NULL)
-        ptr = init_objstr(s, len, hash, OBJ_STRING);
-    
-    return ptr;
+obj_string_t* objstring_conc_n(const value_t* strs, int n){
+    static char* buf = NULL;
+    static size_t capacity = 0;
+
+    size_t len = 0;
+    for(int i = 0; i < n; i++)
+        len += AS_OBJSTRING(strs[i])->len;
+    if(capacity < len + 1){
+        capacity = len + 1;
+        buf = erealloc(buf, capacity);
+    }
+    char* p = buf;
+    for(int i = 0; i < n; i++){
+        memcpy(p, AS_OBJSTRING(strs[i])->str, AS_OBJSTRING(strs[i])->len);
+        p += AS_OBJSTRING(strs[i])->len;
+    }
+    *p = '\0';
+    return stringtable_findstr(buf, len, hash_string(buf, len));
+}
+
+obj_string_t* value_to_objstring(value_t val){
+    char buf[64];
+    if(IS_OBJSTRING(val))
+        return AS_OBJSTRING(val);
+    else if(IS_NUMBER(val))
+        snprintf(buf, sizeof(buf), "%g", AS_NUMBER(val));
+    else if(IS_BOOLEAN(val))
+        snprintf(buf, sizeof(buf), "%s", AS_BOOLEAN(val) ? "true" : "false");
+    else
+        return NULL;
+    size_t len = strlen(buf);
+    return stringtable_findstr(buf, len, hash_string(buf, len));
 }
 
 void obj_free(obj_t* ptr){
@@ -132,7 +163,12 @@ void obj_free(obj_t* ptr){
         case OBJ_STRING: case OBJ_IDENTIFIER:
             free(((obj_string_t*)ptr)->str);
             break;
-        case OBJ_FUNCTION: case OBJ_NATFUNCTION:
+        case OBJ_FUNCTION:
+            free(((obj_function_t*)ptr)->arg_types);
+            if(((obj_function_t*)ptr)->memo != NULL)
+                memo_free(((obj_function_t*)ptr)->memo);
+            break;
+        case OBJ_NATFUNCTION:
             break;
         case OBJ_CLASS:
             table_free(((obj_class_t*)ptr)->fields);
@@ -158,6 +194,27 @@ bool is_value_same_type(const value_t a, const value_t b){
     return true;
 }
 
+bool is_value_static_type(const value_t a, static_type type){
+    switch(type){
+        case ST_ANY: return true;
+        case ST_NUM: return IS_NUMBER(a);
+        case ST_BOOL: return IS_BOOLEAN(a);
+        case ST_STR: return IS_OBJSTRING(a);
+        default:
+            fatal_printf("Undefined static_type in is_value_static_type()\n");
+    }
+}
+
+const char* get_static_type_name(static_type type){
+    static const char* names[] = {
+        [ST_ANY] = "any",
+        [ST_NUM] = "num",
+        [ST_BOOL] = "bool",
+        [ST_STR] = "str"
+    };
+    return names[type];
+}
+
 bool is_equal_objstring(const obj_string_t* s1, const obj_string_t* s2){
     return s1->len == s2->len && strncmp(s1->str, s2->str, s1->len) == 0;
 }
@@ -239,10 +296,13 @@ void examine_value(value_t val){
                     break;
                 }
                 case OBJ_NATFUNCTION:{
-                    printf("%p %s(%d arguments) [native]",
-                    AS_OBJNATFUNCTION(val),
-                    AS_OBJNATFUNCTION(val)->base.name->str,
-                    AS_OBJNATFUNCTION(val)->base.argc);
+                    obj_natfunction_t* p = AS_OBJNATFUNCTION(val);
+                    if(p->base.argc == NATIVE_VARIADIC)
+                        printf("%p %s(variadic) [native]", p, p->base.name->str);
+                    else
+                        printf("%p %s(%d arguments) [native]", p, p->base.name->str, p->base.argc);
+                    if(p->flags & NATIVE_PURE)
+                        printf(" [pure]");
                     break;
                 }
                 case OBJ_CLASS:{
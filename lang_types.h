@@ -27,6 +27,15 @@ typedef struct{
     union _inner_value_t as;
 }value_t;
 
+//optional type annotations ('var i: num', 'func f(a: str)')
+//ST_ANY means that the value is not annotated
+typedef enum{
+    ST_ANY,
+    ST_NUM,
+    ST_BOOL,
+    ST_STR
+}static_type;
+
 typedef enum obj_type{
     OBJ_STRING,    
     OBJ_IDENTIFIER,
@@ -60,14 +69,29 @@ typedef struct obj_func_base_t{
 typedef struct obj_function_t{
     obj_func_base_t base;
     int entry_offset;
+    static_type* arg_types; //NULL if no argument is annotated
+    bool is_pure; //has no side effects, calls with constant arguments are evaluated at compile time
+    struct memo_cache* memo; //cache of results of 'memo func', NULL if calls are not cached
+    //position of the arguments in the source if the body is compiled on the first call, -1 otherwise
+    long source_offset;
+    int source_line;
+    uint32_t calls; //count of calls, it is recorded with --profile or read from the profile
 }obj_function_t;
 
-//argc and argv
+//argc and argv, arguments are stored in reverse order
 typedef value_t (*native_function)(int, value_t*);
 
+//base.argc of a native function that takes any count of arguments
+#define NATIVE_VARIADIC (-1)
+//native function flags
+#define NATIVE_PURE (1 << 0) //has no side effects, calls with constant arguments are evaluated at compile time
+#define NATIVE_ALLOCATES (1 << 1) //may allocate objects, such calls are not evaluated at compile time
+
 typedef struct obj_natfunction_t{
-    obj_func_base_t base;
+    obj_func_base_t base; //base.argc is checked at compile time
     native_function impl;
+    int flags;
+    int intrinsic; //opcode that replaces the call, -1 if the function is called
 }obj_natfunction_t;
 
 /*
@@ -136,15 +160,22 @@ void obj_free(obj_t* ptr);
 obj_string_t* mk_objstring(const char* s, size_t len, int32_t hash);
 obj_id_t* mk_objid(const char* s, size_t len, int32_t hash);
 obj_function_t* mk_objfunc(obj_string_t* name);
-obj_natfunction_t* mk_objnatfunc(obj_string_t* name, native_function impl);
+obj_natfunction_t* mk_objnatfunc(obj_string_t* name, native_function impl, int argc, int flags);
 obj_class_t* mk_objclass(obj_id_t* name);
 obj_instance_t* mk_objinstance(obj_class_t* cl);
 
 obj_string_t* objstring_conc(value_t a, value_t b);
+//concatenates n strings at once, the result is interned
+obj_string_t* objstring_conc_n(const value_t* strs, int n);
+//converts a number or a boolean to a string like print() does
+//return NULL if the value cannot be converted
+obj_string_t* value_to_objstring(value_t val);
 
 bool is_equal_objstring(const obj_string_t* s1, const obj_string_t* s2);
 
 bool is_value_same_type(const value_t a, const value_t b);
+bool is_value_static_type(const value_t a, static_type type);
+const char* get_static_type_name(static_type type);
 
 void set_constructor(obj_class_t* cl, obj_function_t* f);
 obj_function_t* find_constructor(obj_class_t* cl, int argc);
@@ -4,6 +4,8 @@
 #include "utils.h"
 #include "vm.h"
 #include "scope.h"
+#include "bccache.h"
+#include "profile.h"
 #include <stdbool.h>
 #include <string.h>
 #include <errno.h>
@@ -11,32 +13,70 @@
 
 extern int return_code;
 
+#define USAGE "Usage: %s [--cache] [--lazy] [--profile] [input file]\n" \
+    "  --cache    save the compiled bytecode next to the source and reuse it while the source is not changed\n" \
+    "  --lazy     compile bodies of functions on the first call, it is ignored with --cache\n" \
+    "  --profile  save counts of calls and classes at method calls and field reads next to the source,\n" \
+    "             the next runs place hot functions first and cache the classes\n"
+
 int main(int argc, char** argv){
-    if(argc != 2)
-        user_error_printf("Usage: %s [input file]\n", argv[0]);
-    if(strcmp("--help", argv[1]) == 0 ||
-        strcmp("-help", argv[1]) == 0 || 
-        strcmp("-h", argv[1]) == 0){
-        printf("Usage: %s [input file]\n", argv[0]);
-        return 0;
+    const char* input = NULL;
+    bool use_cache = false;
+    bool is_lazy = false;
+    bool is_profiling = false;
+    for(int i = 1; i < argc; i++){
+        if(strcmp("--help", argv[i]) == 0 ||
+            strcmp("-help", argv[i]) == 0 || 
+            strcmp("-h", argv[i]) == 0){
+            printf(USAGE, argv[0]);
+            return 0;
+        }
+        if(strcmp("--cache", argv[i]) == 0)
+            use_cache = true;
+        else if(strcmp("--lazy", argv[i]) == 0)
+            is_lazy = true;
+        else if(strcmp("--profile", argv[i]) == 0)
+            is_profiling = true;
+        else if(input == NULL)
+            input = argv[i];
+        else
+            user_error_printf(USAGE, argv[0]);
     }
+    if(input == NULL)
+        user_error_printf(USAGE, argv[0]);
 
-    FILE* fp = fopen(argv[1], "r");
+    FILE* fp = fopen(input, "r");
     if(fp == NULL)
-        user_error_printf("Failed to open %s: %s\n", argv[1], strerror(errno));
+        user_error_printf("Failed to open %s: %s\n", input, strerror(errno));
+    char* cache_path = use_cache ? bccache_path(input) : NULL;
+    uint64_t source_hash = use_cache ? bccache_hash_file(fp) : 0;
+    //the profiled run counts calls from zero, other runs use the saved profile
+    char* profile = profile_path(input);
+    FILE* profile_fp = is_profiling ? NULL : fopen(profile, "r");
+    bool has_profile = profile_fp != NULL;
+    if(has_profile){
+        //the layout of the cached code depends on the profile
+        if(use_cache)
+            source_hash ^= bccache_hash_file(profile_fp) * 31;
+        fclose(profile_fp);
+    }
 
     symtable_init();
     scope_init();
-    scanner_init(fp);
+    scanner_init(fp, input);
 #ifdef DEBUG
     scanner_debug_tokens();
     //reinitialize the scanner
     fseek(fp, 0, SEEK_SET);
-    scanner_init(fp);
+    scanner_init(fp, input);
 #endif
 
-    vm_interpret();
+    vm_interpret(cache_path, source_hash, is_lazy, is_profiling || has_profile ? profile : NULL, is_profiling);
+    free(cache_path);
+    free(profile);
+    profile_free();
 
+    scanner_cleanup();
     symtable_cleanup();
     gc_cleanup();
     
@@ -0,0 +1,170 @@
+#include "memo.h"
+#include "utils.h"
+#include <string.h>
+
+#define MEMO_NIL (-1)
+
+struct memo_entry{
+    uint32_t hash;
+    int chain; //next entry in the bucket
+    int prev;  //neighbours in the LRU list
+    int next;
+    value_t result;
+};
+
+struct memo_cache{
+    int argc;
+    int capacity;
+    int count;
+    int* buckets;   //capacity is a power of 2
+    int mask;
+    int head;       //the most recently used entry
+    int tail;       //the least recently used entry
+    struct memo_entry* entries;
+    value_t* keys;  //argc values for every entry
+};
+
+static bool is_key(value_t val);
+static uint32_t hash_args(const value_t* argv, int argc);
+static bool is_same_args(const value_t* a, const value_t* b, int argc);
+static void lru_unlink(struct memo_cache* cache, int idx);
+static void lru_push_front(struct memo_cache* cache, int idx);
+static void bucket_unlink(struct memo_cache* cache, int idx);
+
+struct memo_cache* memo_create(int argc, int capacity){
+    struct memo_cache* cache = emalloc(sizeof(struct memo_cache));
+    cache->argc = argc;
+    cache->capacity = capacity;
+    cache->count = 0;
+    cache->head = cache->tail = MEMO_NIL;
+    int buckets = 1;
+    while(buckets < capacity)
+        buckets <<= 1;
+    cache->mask = buckets - 1;
+    cache->buckets = emalloc(sizeof(int) * buckets);
+    for(int i = 0; i < buckets; i++)
+        cache->buckets[i] = MEMO_NIL;
+    cache->entries = emalloc(sizeof(struct memo_entry) * capacity);
+    cache->keys = emalloc(sizeof(value_t) * (argc > 0 ? argc : 1) * capacity);
+    return cache;
+}
+
+void memo_free(struct memo_cache* cache){
+    free(cache->buckets);
+    free(cache->entries);
+    free(cache->keys);
+    free(cache);
+}
+
+int memo_capacity(const struct memo_cache* cache){
+    return cache->capacity;
+}
+
+bool memo_lookup(struct memo_cache* cache, const value_t* argv, value_t* result){
+    for(int i = 0; i < cache->argc; i++)
+        if(!is_key(argv[i]))
+            return false;
+    uint32_t hash = hash_args(argv, cache->argc);
+    for(int idx = cache->buckets[hash & cache->mask]; idx != MEMO_NIL; idx = cache->entries[idx].chain){
+        if(cache->entries[idx].hash == hash && is_same_args(&cache->keys[idx * cache->argc], argv, cache->argc)){
+            if(cache->head != idx){
+                lru_unlink(cache, idx);
+                lru_push_front(cache, idx);
+            }
+            *result = cache->entries[idx].result;
+            return true;
+        }
+    }
+    return false;
+}
+
+void memo_store(struct memo_cache* cache, const value_t* argv, value_t result){
+    for(int i = 0; i < cache->argc; i++)
+        if(!is_key(argv[i]))
+            return;
+    uint32_t hash = hash_args(argv, cache->argc);
+    //the body may have stored the same call recursively
+    for(int idx = cache->buckets[hash & cache->mask]; idx != MEMO_NIL; idx = cache->entries[idx].chain)
+        if(cache->entries[idx].hash == hash && is_same_args(&cache->keys[idx * cache->argc], argv, cache->argc))
+            return;
+
+    int idx;
+    if(cache->count < cache->capacity){
+        idx = cache->count++;
+    }else{
+        idx = cache->tail;
+        lru_unlink(cache, idx);
+        bucket_unlink(cache, idx);
+    }
+    struct memo_entry* e = &cache->entries[idx];
+    e->hash = hash;
+    e->result = result;
+    e->chain = cache->buckets[hash & cache->mask];
+    cache->buckets[hash & cache->mask] = idx;
+    memcpy(&cache->keys[idx * cache->argc], argv, sizeof(value_t) * cache->argc);
+    lru_push_front(cache, idx);
+}
+
+static bool is_key(value_t val){
+    return IS_NUMBER(val) || IS_BOOLEAN(val) || IS_OBJSTRING(val);
+}
+
+//strings are interned, so they are compared and hashed by pointer
+static uint32_t hash_args(const value_t* argv, int argc){
+    uint32_t hash = 2166136261u;
+    for(int i = 0; i < argc; i++){
+        uint64_t bits = 0;
+        if(IS_NUMBER(argv[i])){
+            double num = AS_NUMBER(argv[i]) == 0 ? 0 : AS_NUMBER(argv[i]); //-0 == 0
+            memcpy(&bits, &num, sizeof(num));
+        }else if(IS_BOOLEAN(argv[i])){
+            bits = AS_BOOLEAN(argv[i]);
+        }else{
+            bits = (uint64_t)(uintptr_t)AS_OBJ(argv[i]);
+        }
+        bits ^= (uint64_t)argv[i].type << 56;
+        hash = (hash ^ (uint32_t)bits ^ (uint32_t)(bits >> 32)) * 16777619u;
+    }
+    return hash;
+}
+
+static bool is_same_args(const value_t* a, const value_t* b, int argc){
+    for(int i = 0; i < argc; i++){
+        if(a[i].type != b[i].type)
+            return false;
+        if(IS_NUMBER(a[i]) ? AS_NUMBER(a[i]) != AS_NUMBER(b[i]) :
+           IS_BOOLEAN(a[i]) ? AS_BOOLEAN(a[i]) != AS_BOOLEAN(b[i]) : AS_OBJ(a[i]) != AS_OBJ(b[i]))
+            return false;
+    }
+    return true;
+}
+
+static void lru_unlink(struct memo_cache* cache, int idx){
+    struct memo_entry* e = &cache->entries[idx];
+    if(e->prev != MEMO_NIL)
+        cache->entries[e->prev].next = e->next;
+    else
+        cache->head = e->next;
+    if(e->next != MEMO_NIL)
+        cache->entries[e->next].prev = e->prev;
+    else
+        cache->tail = e->prev;
+}
+
+static void lru_push_front(struct memo_cache* cache, int idx){
+    struct memo_entry* e = &cache->entries[idx];
+    e->prev = MEMO_NIL;
+    e->next = cache->head;
+    if(cache->head != MEMO_NIL)
+        cache->entries[cache->head].prev = idx;
+    cache->head = idx;
+    if(cache->tail == MEMO_NIL)
+        cache->tail = idx;
+}
+
+static void bucket_unlink(struct memo_cache* cache, int idx){
+    int* p = &cache->buckets[cache->entries[idx].hash & cache->mask];
+    while(*p != idx)
+        p = &cache->entries[*p].chain;
+    *p = cache->entries[idx].chain;
+}
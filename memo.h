@@ -0,0 +1,24 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "lang_types.h"
+
+//capacity of the cache of 'memo func' without an explicit size
+#define MEMO_DEFAULT_CAPACITY (1024)
+#define MEMO_MAX_CAPACITY (1 << 20)
+
+//cache of results of a function keyed by its arguments
+//numbers, booleans and interned strings may be keys,
+//the least recently used entry is evicted when the cache is full
+struct memo_cache;
+
+struct memo_cache* memo_create(int argc, int capacity);
+void memo_free(struct memo_cache* cache);
+int memo_capacity(const struct memo_cache* cache);
+//argv contains argc arguments in the stack order
+//return true and write the result if the call is cached
+bool memo_lookup(struct memo_cache* cache, const value_t* argv, value_t* result);
+//does nothing if some of the arguments cannot be a key
+void memo_store(struct memo_cache* cache, const value_t* argv, value_t result);
+
+#endif
@@ -5,6 +5,7 @@
 #include "vm.h"
 #include "hash_table.h"
 #include <stdint.h>
+#include <math.h>
 #include <time.h>
 
 #define UNUSED(x) ((void)(x))
@@ -12,10 +13,11 @@
 extern int is_done;
 extern int return_code;
 
+//count of arguments is checked at compile time for the functions with fixed arity
+
 value_t native_clock(int argc, value_t* argv){
+    UNUSED(argc);
     UNUSED(argv);
-    if(argc != 0)
-        interpret_error_printf(get_vm_codeline(), "Expected 0 arguments in 'clock' function call, found %d\n",argc);
     return VALUE_NUMBER(clock() / CLOCKS_PER_SEC);
 }
 
@@ -61,47 +63,33 @@ value_t native_println(int argc, value_t* argv){
 
 
 value_t native_isnum(int argc, value_t* argv){
-    if(argc != 1)
-        interpret_error_printf(get_vm_codeline(),
-     "Expected 1 argument in 'isnum' function call, found %d\n", argc);
+    UNUSED(argc);
     return VALUE_BOOLEAN(IS_NUMBER(argv[0]));
 }
 value_t native_isstr(int argc, value_t* argv){
-    if(argc != 1)
-        interpret_error_printf(get_vm_codeline(),
-    "Expected 1 argument in 'isstr' function call, found %d\n", argc);
+    UNUSED(argc);
     return VALUE_BOOLEAN(IS_OBJSTRING(argv[0]));
 }
 value_t native_isbool(int argc, value_t* argv){
-    if(argc != 1)
-        interpret_error_printf(get_vm_codeline(),
-     "Expected 1 argument in 'isbool' function call, found %d\n", argc);
+    UNUSED(argc);
     return VALUE_BOOLEAN(IS_BOOLEAN(argv[0]));
 }
 value_t native_isinst(int argc, value_t* argv){
-    if(argc != 1)
-        interpret_error_printf(get_vm_codeline(),
-     "Expected 1 argument in 'isinst' function call, found %d\n", argc);
+    UNUSED(argc);
     return VALUE_BOOLEAN(IS_OBJINSTANCE(argv[0]));
 }
 
 value_t native_isnone(int argc, value_t* argv){
-    if(argc != 1)
-        interpret_error_printf(get_vm_codeline(),
-     "Expected 1 argument in 'isnone' function call, found %d\n", argc);
+    UNUSED(argc);
     return VALUE_BOOLEAN(IS_NONE(argv[0]));
 }
 value_t native_isuninit(int argc, value_t* argv){
-    if(argc != 1)
-        interpret_error_printf(get_vm_codeline(),
-     "Expected 1 argument in 'isuninit' function call, found %d\n", argc);
+    UNUSED(argc);
     return VALUE_BOOLEAN(IS_UNINIT(argv[0]));
 }
 
 value_t native_exit(int argc, value_t* argv){
-    if(argc != 1)
-        interpret_error_printf(get_vm_codeline(),
-     "Expected 1 argument in 'exit' function call, found %d\n",argc);
+    UNUSED(argc);
     if(!IS_NUMBER(argv[0]))
         interpret_error_printf(get_vm_codeline(), "Expected number as argument in 'exit' function call\n");
     is_done = 1;
@@ -110,14 +98,46 @@ value_t native_exit(int argc, value_t* argv){
 }
 
 value_t native_getchar(int argc, value_t* argv){
+    UNUSED(argc);
     UNUSED(argv);
-    if(argc!= 0)
-        interpret_error_printf(get_vm_codeline(),
-     "Expected 0 arguments in 'getchar' function call, found %d\n", argc);
     int ch = getchar();
     if(ch == EOF)
         return VALUE_NONE;
     int32_t hash = hash_string((char*)&ch,1);
     obj_string_t* retval = stringtable_findstr((char*)&ch, 1, hash);
     return VALUE_OBJ(retval);
-}
\ No newline at end of file
+}
+
+//arguments are stored in reverse order
+#define MATH_ARGS(name) do{\
+    for(int i = 0; i < argc; i++)\
+        if(!IS_NUMBER(argv[i]))\
+            interpret_error_printf(get_vm_codeline(), "Expected number as argument in '" name "' function call\n");\
+}while(0)
+
+value_t native_sqrt(int argc, value_t* argv){
+    MATH_ARGS("sqrt");
+    return VALUE_NUMBER(sqrt(AS_NUMBER(argv[0])));
+}
+value_t native_floor(int argc, value_t* argv){
+    MATH_ARGS("floor");
+    return VALUE_NUMBER(floor(AS_NUMBER(argv[0])));
+}
+value_t native_abs(int argc, value_t* argv){
+    MATH_ARGS("abs");
+    return VALUE_NUMBER(fabs(AS_NUMBER(argv[0])));
+}
+value_t native_min(int argc, value_t* argv){
+    MATH_ARGS("min");
+    return VALUE_NUMBER(fmin(AS_NUMBER(argv[1]), AS_NUMBER(argv[0])));
+}
+value_t native_max(int argc, value_t* argv){
+    MATH_ARGS("max");
+    return VALUE_NUMBER(fmax(AS_NUMBER(argv[1]), AS_NUMBER(argv[0])));
+}
+value_t native_pow(int argc, value_t* argv){
+    MATH_ARGS("pow");
+    return VALUE_NUMBER(pow(AS_NUMBER(argv[1]), AS_NUMBER(argv[0])));
+}
+
+#undef MATH_ARGS
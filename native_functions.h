@@ -3,6 +3,15 @@
 
 #include "lang_types.h"
 
+//description of a built-in function for the symtable
+struct native_info{
+    const char* name;
+    native_function impl;
+    int argc; //count of arguments or NATIVE_VARIADIC
+    int flags; //NATIVE_PURE, NATIVE_ALLOCATES
+    int intrinsic; //opcode that replaces the call or -1
+};
+
 value_t native_clock(int argc, value_t* argv);
 value_t native_print(int argc, value_t* argv);
 value_t native_println(int argc, value_t* argv);
@@ -14,6 +23,13 @@ value_t native_isinst(int argc, value_t* argv);
 value_t native_isnone(int argc, value_t* argv);
 value_t native_isuninit(int argc, value_t* argv);
 
+value_t native_sqrt(int argc, value_t* argv);
+value_t native_floor(int argc, value_t* argv);
+value_t native_abs(int argc, value_t* argv);
+value_t native_min(int argc, value_t* argv);
+value_t native_max(int argc, value_t* argv);
+value_t native_pow(int argc, value_t* argv);
+
 value_t native_exit(int argc, value_t* argv);
 value_t native_getchar(int argc, value_t* argv);
 #endif 
\ No newline at end of file
@@ -8,7 +8,10 @@
 #include "symtable.h"
 #include "token.h"
 #include "utils.h"
+#include "memo.h"
 #include "hash_table.h"
+#include "profile.h"
+#include <string.h>
 
 /*
 TODO: optimisation ast_eval()
@@ -32,6 +35,10 @@ static const int precedence[] = {
     [T_DECR] = 0,
     [T_INCR] = 0,
     [T_ASSIGN] = 1,
+    [T_ADD_ASSIGN] = 1,
+    [T_SUB_ASSIGN] = 1,
+    [T_MUL_ASSIGN] = 1,
+    [T_DIV_ASSIGN] = 1,
     [T_LPAR] = 11,
     [T_RPAR] = -1,
     [T_INT] = 0,
@@ -39,6 +46,8 @@ static const int precedence[] = {
     [T_TRUE] = 0,
     [T_IDENT] = 0,
     [T_STRING] = 0,
+    [T_INTERP] = -1,
+    [T_INTERP_END] = -1,
     [T_VAR] = 0,
     [T_SEMI] = -1,
     [T_LBRACE] = 0,
@@ -57,13 +66,28 @@ static const int precedence[] = {
     [T_THIS] = 0,
     [T_COLON] = 0,
     [T_OVERRIDE] = 0,
+    [T_SWITCH] = 0,
+    [T_CASE] = 0,
+    [T_DEFAULT] = 0,
+    [T_TRY] = 0,
+    [T_CATCH] = 0,
+    [T_THROW] = 0,
+    [T_MEMO] = 0,
+    [T_IMPORT] = 0,
     [T_EOF] = 0
 };
 
 #define PRECEDENCE_ARR_SIZE (sizeof(precedence) / sizeof(int))
+//open brackets in a body skipped by the lazy parser
+#define SKIP_NESTING_LIMIT (256)
 
 extern struct token cur_token;
 
+//'memo func' that is being compiled, its returns store the result in the cache
+static obj_function_t* memo_func = NULL;
+//bodies of functions are compiled on the first call
+static bool is_lazy = false;
+
 static inline ast_node_type token_to_ast(token_type t);
 static inline int get_op_precedence(token_type op);
 static ast_node* ast_bin_expr(int prev_precedence);
@@ -78,12 +102,27 @@ static void parse_var(struct bytecode_chunk* chunk);
 static void parse_if(struct bytecode_chunk* chunk);
 static void parse_while(struct bytecode_chunk* chunk);
 static void parse_for(struct bytecode_chunk* chunk);
+static void parse_switch(struct bytecode_chunk* chunk);
+static value_t parse_case_key();
+static void parse_try(struct bytecode_chunk* chunk);
+static void parse_throw(struct bytecode_chunk* chunk);
 static void parse_return(struct bytecode_chunk* chunk);
-
-static void parse_func(struct bytecode_chunk* chunk);
+static void write_return(struct bytecode_chunk* chunk);
+
+static void parse_memo(struct bytecode_chunk* chunk);
+//compiles the imported file in place of the import, a file is compiled once
+static void parse_import(struct bytecode_chunk* chunk);
+//memo_capacity is 0 if calls are not cached
+static void parse_func(struct bytecode_chunk* chunk, int memo_capacity);
+static static_type parse_type_annotation();
 static int count_func_args();
 static struct ast_call_arg* parse_func_args();
 static void parse_func_definition(struct bytecode_chunk* chunk, obj_function_t* func);
+//return the function in the symtable, it may be declared before
+static obj_function_t* define_func(obj_function_t* func);
+static void parse_func_body(struct bytecode_chunk* chunk, obj_function_t* func);
+//records the position of the arguments and skips the body
+static void skip_func_definition(obj_function_t* func, struct scanner_position args);
 static void parse_func_declaration(obj_function_t* func);
 
 static void parse_class_declaration(struct bytecode_chunk* chunk);
@@ -112,6 +151,10 @@ static inline ast_node_type token_to_ast(token_type t){
         [T_LESS] = AST_LESS, 
         [T_ELESS] = AST_ELESS,
         [T_ASSIGN] = AST_ASSIGN,
+        [T_ADD_ASSIGN] = AST_ADD_ASSIGN,
+        [T_SUB_ASSIGN] = AST_SUB_ASSIGN,
+        [T_MUL_ASSIGN] = AST_MUL_ASSIGN,
+        [T_DIV_ASSIGN] = AST_DIV_ASSIGN,
         [T_DOT] = AST_PROPERTY,
         [T_LPAR] = AST_CALL
     };
@@ -159,6 +202,26 @@ static ast_node* ast_primary(){
             return ast_mknode(AST_NOT, AST_DATA_PTR(ast_primary()));
         case T_STRING:
             return ast_mknode_string(cur_token.data.ptr);
+        case T_INTERP:{
+            //"text ${expr} text ${expr} text"
+            struct ast_call_arg* parts = NULL;
+            while(1){
+                struct ast_call_arg* temp;
+                if(((obj_string_t*)cur_token.data.ptr)->len > 0){
+                    temp = ast_mk_call_arg(ast_mknode_string(cur_token.data.ptr));
+                    temp->next = parts;
+                    parts = temp;
+                }
+                if(is_match(T_INTERP_END))
+                    break;
+                temp = ast_mk_call_arg(ast_bin_expr(0));
+                temp->next = parts;
+                parts = temp;
+                if(!is_match(T_INTERP) && !is_match(T_INTERP_END))
+                    compile_error_printf("Expected '}' in the interpolated string\n");
+            }
+            return ast_mknode(AST_INTERP, AST_DATA_PTR(parts));
+        }
         case T_ADD:
             return ast_primary();
         case T_SUB:
@@ -253,6 +316,26 @@ bool parse_command(struct bytecode_chunk* chunk){
             parse_for(chunk);
             break;
         }
+        case T_SWITCH:{
+            IS_GLOBAL_SCOPE("Statement is not expected in global scope.\n");
+            parse_switch(chunk);
+            break;
+        }
+        case T_TRY:{
+            IS_GLOBAL_SCOPE("Statement is not expected in global scope.\n");
+            parse_try(chunk);
+            break;
+        }
+        case T_CATCH:
+            compile_error_printf("'catch' is expected only after a try block\n");
+        case T_THROW:{
+            IS_GLOBAL_SCOPE("Statement is not expected in global scope.\n");
+            parse_throw(chunk);
+            break;
+        }
+        case T_CASE:
+        case T_DEFAULT:
+            compile_error_printf("'%s' is expected only in a switch statement\n", is_match(T_CASE) ? "case" : "default");
         case T_BREAK:{
             if(!is_cycle())
                 compile_error_printf("Cannot use 'break' outside a loop\n");
@@ -272,7 +355,19 @@ bool parse_command(struct bytecode_chunk* chunk){
                 compile_error_printf("Function declaration expected in the global scope\n");
             if(scope_get_class() != NULL)
                 compile_error_printf("Function declaration is not expected in a class declaration. Maybe you wanted 'meth'?\n");
-            parse_func(chunk);
+            parse_func(chunk, 0);
+            break;
+        }
+        case T_MEMO:{
+            if(!is_global_scope() || scope_get_class() != NULL)
+                compile_error_printf("'memo' is expected only before a function in the global scope\n");
+            parse_memo(chunk);
+            break;
+        }
+        case T_IMPORT:{
+            if(!is_global_scope() || scope_get_class() != NULL)
+                compile_error_printf("'import' is expected only in the global scope\n");
+            parse_import(chunk);
             break;
         }
         case T_RETURN:{
@@ -313,7 +408,8 @@ static void parse_var(struct bytecode_chunk* chunk){
     next_expect(T_IDENT, "Expected identifier\n");
 
     obj_string_t* var = cur_token.data.ptr;
-    if(!declare_variable(var))
+    static_type type = parse_type_annotation();
+    if(!declare_variable(var, type))
         compile_error_printf("'%s' has already defined\n", var->str);
 
     next_expect(T_ASSIGN, "Expected expression\n");
@@ -347,51 +443,50 @@ static void parse_simple_expression(struct bytecode_chunk* chunk){
 static void parse_if(struct bytecode_chunk* chunk){
     next_expect(T_LPAR, "Expected '('\n");
     ast_node* log_expr = ast_process_expr();
-    bcchunk_write_expression(log_expr, chunk, line_counter);
+    int false_jumps = bcchunk_write_condition(log_expr, false, chunk, line_counter);
+    ast_freenode(log_expr);
     cur_expect(T_RPAR, "Expected ')'\n");
 
-    bcchunk_write_simple_op(chunk, OP_FJUMP, line_counter);
-    int offset;
-    offset = bcchunk_get_codesize(chunk); 
-    bcchunk_write_constant(chunk, -(int)sizeof(int), line_counter); 
     READ_BLOCK(chunk);
 
     if(!scanner_next_token() || !is_match(T_ELSE)){
-        UPDATE_JUMP_LENGTH(chunk, offset);
+        bcchunk_patch_jumps(chunk, false_jumps, bcchunk_get_codesize(chunk));
         scanner_putback_token();
         return;
     }
 
     bcchunk_write_simple_op(chunk, OP_JUMP, line_counter);
     bcchunk_write_constant(chunk, -(int)sizeof(int), line_counter); 
-    UPDATE_JUMP_LENGTH(chunk, offset);
+    bcchunk_patch_jumps(chunk, false_jumps, bcchunk_get_codesize(chunk));
 
-    offset = bcchunk_get_codesize(chunk) - sizeof(int); 
+    int offset = bcchunk_get_codesize(chunk) - sizeof(int); 
 
     READ_BLOCK(chunk);
     UPDATE_JUMP_LENGTH(chunk, offset);
 
 }
 
+//the condition is placed after the body,
+//so an iteration makes only one conditional jump back
 static void parse_while(struct bytecode_chunk* chunk){
     next_expect(T_LPAR, "Expected '('\n");
-    int start = bcchunk_get_codesize(chunk);
     ast_node* log_expr = ast_process_expr();
+    int cond_line = line_counter;
+    cur_expect(T_RPAR, "Expected ')'\n");
     begin_cycle(chunk);
-    bcchunk_write_expression(log_expr, chunk, line_counter);
 
-    bcchunk_write_simple_op(chunk, OP_FJUMP, line_counter);
-    int offset = bcchunk_get_codesize(chunk);
+    bcchunk_write_simple_op(chunk, OP_JUMP, line_counter);
+    int entry = bcchunk_get_codesize(chunk);
     bcchunk_write_constant(chunk, -(int)sizeof(int), line_counter);
-    cur_expect(T_RPAR, "Expected ')'\n");
 
-    next_expect(T_LBRACE, "Expected '{'\n");
-    read_block(chunk);
-
-    bcchunk_write_simple_op(chunk, OP_JUMP, line_counter);
-    bcchunk_write_constant(chunk, start - (bcchunk_get_codesize(chunk) + sizeof(int)), line_counter);
+    int body_start = bcchunk_get_codesize(chunk);
+    READ_BLOCK(chunk);
 
-    UPDATE_JUMP_LENGTH(chunk, offset);
+    change_start_offset(bcchunk_get_codesize(chunk));
+    UPDATE_JUMP_LENGTH(chunk, entry);
+    int true_jumps = bcchunk_write_condition(log_expr, true, chunk, cond_line);
+    bcchunk_patch_jumps(chunk, true_jumps, body_start);
+    ast_freenode(log_expr);
     end_cycle(chunk);
 }
 
@@ -404,10 +499,14 @@ static void parse_for(struct bytecode_chunk* chunk){
     switch(cur_token.type){
         case T_VAR: parse_var(chunk); break;
         case T_SEMI: break;
-        default:
+        default:{
             scanner_putback_token();
-            bcchunk_write_expression(ast_process_expr(), chunk, line_counter);
+            ast_node* init = ast_process_expr();
+            bcchunk_write_expression(init, chunk, line_counter);
+            bcchunk_write_simple_op(chunk, OP_POP, line_counter);
+            ast_freenode(init);
             break;
+        }
     }
 
     cur_expect(T_SEMI, "Expected ';'\n");
@@ -415,20 +514,13 @@ static void parse_for(struct bytecode_chunk* chunk){
     if(!scanner_next_token())
         compile_error_printf("Expected expression\n");
 
-    int loop_start = bcchunk_get_codesize(chunk);
-    switch(cur_token.type){
-        case T_SEMI:
-            bcchunk_write_simple_op(chunk, OP_BOOLEAN, line_counter);
-            bcchunk_write_value(chunk, VALUE_BOOLEAN(true), line_counter);
-            break;
-        default:
-            scanner_putback_token();
-            bcchunk_write_expression(ast_process_expr(), chunk, line_counter);
-            break;
+    ast_node* cond = NULL;
+    int cond_line = line_counter;
+    if(!is_match(T_SEMI)){
+        scanner_putback_token();
+        cond = ast_process_expr();
+        cond_line = line_counter;
     }
-    bcchunk_write_simple_op(chunk, OP_FJUMP, line_counter);
-    int cond_mark = bcchunk_get_codesize(chunk);
-    bcchunk_write_constant(chunk, -(int)sizeof(int), line_counter);
 
     cur_expect(T_SEMI, "Expected ';'\n");
 
@@ -446,36 +538,226 @@ static void parse_for(struct bytecode_chunk* chunk){
 
     cur_expect(T_RPAR, "Expected ')'\n");
 
+    //counted loop performs the step and the condition in one instruction
+    op_t loop_op;
+    bool is_counted = bcchunk_is_counted_loop(cond, postexpr, &loop_op);
+    int counter = 0, limit = 0;
+    if(is_counted){
+        struct ast_binary* temp = cond->data.ptr;
+        counter = scope_resolve_slot(AS_OBJIDENTIFIER(temp->left->data.val));
+        if(temp->right->type == AST_NUMBER){
+            bcchunk_write_expression(temp->right, chunk, cond_line);
+            limit = scope_add_hidden_local(ST_NUM);
+        }else{
+            limit = scope_resolve_slot(AS_OBJIDENTIFIER(temp->right->data.val));
+        }
+    }
+    start_cycle_body();
+
+    //counted loop checks the condition before the first iteration,
+    //other loops jump to the condition after the body
+    int exit_jumps = JUMP_LIST_END;
+    int entry = -1;
+    if(is_counted){
+        exit_jumps = bcchunk_write_condition(cond, false, chunk, cond_line);
+    }else if(cond){
+        bcchunk_write_simple_op(chunk, OP_JUMP, cond_line);
+        entry = bcchunk_get_codesize(chunk);
+        bcchunk_write_constant(chunk, -(int)sizeof(int), cond_line);
+    }
+
+    int body_start = bcchunk_get_codesize(chunk);
     if(!scanner_next_token())
         compile_error_printf("Expected '{' or ';'\n");
-    if(is_match(T_LBRACE))
+    if(is_match(T_LBRACE)){
+        begin_scope();
         read_block(chunk);
-    else
+        end_scope(chunk);
+    }else{
         cur_expect(T_SEMI, "Expected '{' or ';'\n");
+    }
 
     change_start_offset(bcchunk_get_codesize(chunk));
-    if(postexpr){
-        bcchunk_write_expression(postexpr, chunk, postexpr_line);
-        bcchunk_write_simple_op(chunk, OP_POP, postexpr_line);
+    if(is_counted){
+        bcchunk_write_counted_loop(loop_op, counter, limit, body_start, chunk, postexpr_line);
+    }else{
+        if(postexpr){
+            bcchunk_write_expression(postexpr, chunk, postexpr_line);
+            bcchunk_write_simple_op(chunk, OP_POP, postexpr_line);
+        }
+        if(cond){
+            UPDATE_JUMP_LENGTH(chunk, entry);
+            int true_jumps = bcchunk_write_condition(cond, true, chunk, cond_line);
+            bcchunk_patch_jumps(chunk, true_jumps, body_start);
+        }else{
+            bcchunk_write_simple_op(chunk, OP_JUMP, postexpr_line);
+            bcchunk_write_constant(chunk, body_start - (bcchunk_get_codesize(chunk) + sizeof(int)), postexpr_line);
+        }
     }
-    bcchunk_write_simple_op(chunk, OP_JUMP, postexpr_line);
-    bcchunk_write_constant(chunk, loop_start - (bcchunk_get_codesize(chunk) + sizeof(int)), postexpr_line);
 
-    UPDATE_JUMP_LENGTH(chunk, cond_mark);
+    bcchunk_patch_jumps(chunk, exit_jumps, bcchunk_get_codesize(chunk));
+    if(cond)
+        ast_freenode(cond);
+    if(postexpr)
+        ast_freenode(postexpr);
     end_cycle(chunk);
 }
 
-static void parse_func(struct bytecode_chunk* chunk){
+//cases don't fall through
+static void parse_switch(struct bytecode_chunk* chunk){
+    next_expect(T_LPAR, "Expected '('\n");
+    ast_node* expr = ast_process_expr();
+    bcchunk_write_expression(expr, chunk, line_counter);
+    ast_freenode(expr);
+    cur_expect(T_RPAR, "Expected ')'\n");
+
+    //table is chosen when all cases are known
+    int op_offset = bcchunk_get_codesize(chunk);
+    bcchunk_write_simple_op(chunk, OP_SWITCH_TABLE, line_counter);
+    bcchunk_write_constant(chunk, 0, line_counter);
+
+    struct switch_case* cases = NULL;
+    int count = 0;
+    int default_target = -1;
+    int end_jumps = JUMP_LIST_END;
+    next_expect(T_LBRACE, "Expected '{'\n");
+    while(scanner_next_token() && !is_match(T_RBRACE)){
+        int target = bcchunk_get_codesize(chunk);
+        if(is_match(T_DEFAULT)){
+            if(default_target != -1)
+                compile_error_printf("Multiple 'default' in a switch statement\n");
+            default_target = target;
+        }else if(is_match(T_CASE)){
+            do{
+                value_t key = parse_case_key();
+                for(int i = 0; i < count; i++){
+                    if(IS_NUMBER(key) != IS_NUMBER(cases[i].key))
+                        compile_error_printf("All case constants must be of the same type\n");
+                    if(IS_NUMBER(key) ? AS_NUMBER(key) == AS_NUMBER(cases[i].key) : AS_OBJ(key) == AS_OBJ(cases[i].key))
+                        compile_error_printf("Duplicate case constant\n");
+                }
+                cases = erealloc(cases, sizeof(struct switch_case) * (count + 1));
+                cases[count].key = key;
+                cases[count++].target = target;
+            }while(scanner_next_token() && is_match(T_COMMA));
+            scanner_putback_token();
+        }else{
+            compile_error_printf("Expected 'case' or 'default'\n");
+        }
+        next_expect(T_COLON, "Expected ':'\n");
+        READ_BLOCK(chunk);
+
+        bcchunk_write_simple_op(chunk, OP_JUMP, line_counter);
+        int offset = bcchunk_get_codesize(chunk);
+        bcchunk_write_constant(chunk, end_jumps, line_counter);
+        end_jumps = offset;
+    }
+    cur_expect(T_RBRACE, "Unclosed statement block, '}' expected\n");
+
+    int end = bcchunk_get_codesize(chunk);
+    bcchunk_patch_jumps(chunk, end_jumps, end);
+    bcchunk_write_switch(chunk, op_offset, cases, count, default_target == -1 ? end : default_target);
+    free(cases);
+}
+
+//number or string constant
+static value_t parse_case_key(){
+    if(!scanner_next_token())
+        compile_error_printf("Expected case constant\n");
+    bool is_negative = is_match(T_SUB);
+    if(is_negative && !scanner_next_token())
+        compile_error_printf("Expected case constant\n");
+    if(is_match(T_INT))
+        return VALUE_NUMBER(is_negative ? -cur_token.data.num : cur_token.data.num);
+    if(is_match(T_STRING) && !is_negative)
+        return VALUE_OBJ(cur_token.data.ptr);
+    compile_error_printf("Expected number or string as case constant\n");
+}
+
+//try block doesn't emit any instructions, only an entry of the exception table
+//the VM pushes the exception as the next local and jumps to the catch block
+static void parse_try(struct bytecode_chunk* chunk){
+    struct exception_handler handler;
+    handler.start = bcchunk_get_codesize(chunk);
+    handler.depth = scope_get_locals_count();
+    READ_BLOCK(chunk);
+    handler.end = bcchunk_get_codesize(chunk);
+
+    bcchunk_write_simple_op(chunk, OP_JUMP, line_counter);
+    int offset = bcchunk_get_codesize(chunk);
+    bcchunk_write_constant(chunk, -(int)sizeof(int), line_counter);
+
+    next_expect(T_CATCH, "Expected 'catch' after a try block\n");
+    next_expect(T_LPAR, "Expected '('\n");
+    next_expect(T_IDENT, "Expected identifier\n");
+    obj_id_t* id = cur_token.data.ptr;
+    next_expect(T_RPAR, "Expected ')'\n");
+
+    handler.target = bcchunk_get_codesize(chunk);
+    bcchunk_add_handler(chunk, &handler);
+    begin_scope();
+    scope_add_pushed_local(id);
+    READ_BLOCK(chunk);
+    end_scope(chunk);
+    UPDATE_JUMP_LENGTH(chunk, offset);
+}
+
+static void parse_throw(struct bytecode_chunk* chunk){
+    ast_node* expr = ast_process_expr();
+    bcchunk_write_expression(expr, chunk, line_counter);
+    bcchunk_write_simple_op(chunk, OP_THROW, line_counter);
+    cur_expect(T_SEMI, "Expected ';'\n");
+    ast_freenode(expr);
+}
+
+//'memo func' or 'memo(capacity) func'
+static void parse_memo(struct bytecode_chunk* chunk){
+    int capacity = MEMO_DEFAULT_CAPACITY;
+    scanner_next_token();
+    if(is_match(T_LPAR)){
+        next_expect(T_INT, "Expected capacity of the cache\n");
+        capacity = cur_token.data.num;
+        if(capacity <= 0 || capacity > MEMO_MAX_CAPACITY)
+            compile_error_printf("Capacity of the cache must be from 1 to %d\n", MEMO_MAX_CAPACITY);
+        next_expect(T_RPAR, "Expected ')'\n");
+        scanner_next_token();
+    }
+    cur_expect(T_FUNC, "Expected 'func' after 'memo'\n");
+    parse_func(chunk, capacity);
+}
+
+static void parse_import(struct bytecode_chunk* chunk){
+    next_expect(T_STRING, "Expected path of the imported file\n");
+    obj_string_t* path = cur_token.data.ptr;
+    next_expect(T_SEMI, "Expected ';'\n");
+    if(!scanner_import(path->str))
+        return;
+    while(parse_command(chunk));
+    scanner_end_import();
+}
+
+void parser_set_lazy(bool lazy){
+    is_lazy = lazy;
+}
+
+static void parse_func(struct bytecode_chunk* chunk, int memo_capacity){
     next_expect(T_IDENT, "Expected identifier\n");
     obj_function_t* p = mk_objfunc(cur_token.data.ptr);
 
     next_expect(T_LPAR, "Expected '('\n");
+    struct scanner_position args = scanner_tell();
     begin_scope();
     p->base.argc = count_func_args();
+    p->arg_types = scope_get_argument_types();
     cur_expect(T_RPAR, "Expected ')'\n");
+    if(memo_capacity > 0)
+        p->memo = memo_create(p->base.argc, memo_capacity);
 
     scanner_next_token();
-    if(is_match(T_LBRACE)){
+    //the skipped body is scanned again from the main file
+    if(is_match(T_LBRACE) && is_lazy && scanner_import_name() == NULL){
+        skip_func_definition(p, args);
+    }else if(is_match(T_LBRACE)){
         parse_func_definition(chunk, p);
     }else{
         parse_func_declaration(p);
@@ -484,13 +766,28 @@ static void parse_func(struct bytecode_chunk* chunk){
 
 }
 
+//reads optional ': type' after an identifier
+static static_type parse_type_annotation(){
+    if(!scanner_next_token() || !is_match(T_COLON)){
+        scanner_putback_token();
+        return ST_ANY;
+    }
+    next_expect(T_IDENT, "Expected type name\n");
+    const char* name = ((obj_id_t*)cur_token.data.ptr)->str;
+    for(static_type t = ST_NUM; t <= ST_STR; t++)
+        if(strcmp(name, get_static_type_name(t)) == 0)
+            return t;
+    compile_error_printf("Undefined type '%s'\n", name);
+}
+
 static int count_func_args(){
     int c = 0;
     scanner_next_token();
     if(!is_match(T_RPAR)){
         do{
             cur_expect(T_IDENT, "Expected identifier\n");
-            declare_argument(cur_token.data.ptr);
+            obj_id_t* id = cur_token.data.ptr;
+            declare_argument(id, parse_type_annotation());
             c++;
             scanner_next_token();
             if(!is_match(T_COMMA))
@@ -518,7 +815,92 @@ static struct ast_call_arg* parse_func_args(){
     return args;
 }
 
+static bool is_same_arg_types(const obj_function_t* a, const obj_function_t* b){
+    for(int i = 0; i < a->base.argc; i++){
+        static_type t1 = a->arg_types ? a->arg_types[i] : ST_ANY;
+        static_type t2 = b->arg_types ? b->arg_types[i] : ST_ANY;
+        if(t1 != t2)
+            return false;
+    }
+    return true;
+}
+
 static void parse_func_definition(struct bytecode_chunk* chunk, obj_function_t* func){
+    parse_func_body(chunk, define_func(func));
+}
+
+static void skip_func_definition(obj_function_t* func, struct scanner_position args){
+    func = define_func(func);
+    func->source_offset = args.offset;
+    func->source_line = args.line;
+    //brackets, nested functions and calls are checked like in the compiled body,
+    //so the errors are reported even if the body is never compiled
+    //an open '(' of the header of 'for' is kept as T_FOR, it contains ';'
+    token_type open[SKIP_NESTING_LIMIT] = {T_LBRACE};
+    struct token prev[2] = {{.type = T_LBRACE}, {.type = T_LBRACE}};
+    for(int depth = 1; depth > 0;){
+        if(!scanner_next_token())
+            compile_error_printf("Unclosed statement block, '}' expected\n");
+        token_type top = open[depth - 1];
+        switch(cur_token.type){
+            case T_LBRACE: case T_LPAR:
+                if(is_match(T_LBRACE) && (top == T_LPAR || top == T_FOR))
+                    compile_error_printf("Expected ')'\n");
+                if(depth == SKIP_NESTING_LIMIT)
+                    compile_error_printf("Too deep nesting of brackets\n");
+                open[depth++] = is_match(T_LPAR) && prev[1].type == T_FOR ? T_FOR : cur_token.type;
+                break;
+            case T_RBRACE: case T_SEMI:
+                if(top == T_LPAR)
+                    compile_error_printf("Unclosed left parenthesis, ')' expected\n");
+                if(is_match(T_RBRACE) && top == T_FOR)
+                    compile_error_printf("Expected ')'\n");
+                if(is_match(T_RBRACE))
+                    depth--;
+                break;
+            case T_RPAR:
+                if(top == T_LBRACE)
+                    compile_error_printf("Unexpected ')'\n");
+                depth--;
+                break;
+            case T_FUNC:
+                compile_error_printf("Function declaration expected in the global scope\n");
+            default:
+                break;
+        }
+        //the body sees only functions and classes declared before it
+        if(is_match(T_LPAR) && prev[1].type == T_IDENT && prev[0].type != T_DOT){
+            value_t val;
+            if(!symtable_get(prev[1].data.ptr, &val) || IS_NONE(val))
+                compile_error_printf("'%s' is not defined\n", ((obj_id_t*)prev[1].data.ptr)->str);
+        }
+        prev[0] = prev[1];
+        prev[1] = cur_token;
+    }
+}
+
+bool parse_lazy_function(struct bytecode_chunk* chunk, obj_function_t* func){
+    //the body is in the main file, it is not scanned again while an import is scanned
+    if(func->source_offset < 0 || scanner_import_name() != NULL)
+        return false;
+    //it may be called while a global initializer is parsed
+    struct scanner_position pos = scanner_tell();
+    struct token token = cur_token;
+    scanner_seek((struct scanner_position){.offset = func->source_offset, .line = func->source_line});
+    func->source_offset = -1;
+    //arguments are declared again, their types are already known
+    begin_scope();
+    count_func_args();
+    cur_expect(T_RPAR, "Expected ')'\n");
+    next_expect(T_LBRACE, "Expected '{'\n");
+    parse_func_body(chunk, func);
+    end_scope(chunk);
+    scanner_seek(pos);
+    cur_token = token;
+    return true;
+}
+
+static obj_function_t* define_func(obj_function_t* func){
     value_t val;
     if(symtable_get(func->base.name, &val) && !IS_NONE(val)){
         if(!IS_OBJFUNCTION(val)){
@@ -527,16 +909,31 @@ static void parse_func_definition(struct bytecode_chunk* chunk, obj_function_t*
             else
                 compile_error_printf("'%s' has already defined\n", func->base.name->str);
         }
-        if(AS_OBJFUNCTION(val)->entry_offset != -1)
+        if(AS_OBJFUNCTION(val)->entry_offset != -1 || AS_OBJFUNCTION(val)->source_offset >= 0)
             compile_error_printf("'%s' function redefinition\n", func->base.name->str);
-        if(AS_OBJFUNCTION(val)->base.argc != func->base.argc)
+        if(AS_OBJFUNCTION(val)->base.argc != func->base.argc ||
+            !is_same_arg_types(AS_OBJFUNCTION(val), func))
             compile_error_printf("Conflicting with a declaration of '%s' function\n", func->base.name->str);
+        //'memo' may be written either in the declaration or in the definition
+        if(AS_OBJFUNCTION(val)->memo == NULL){
+            AS_OBJFUNCTION(val)->memo = func->memo;
+            func->memo = NULL;
+        }
         func = AS_OBJFUNCTION(val);
     }
-    func->entry_offset = bcchunk_get_codesize(chunk);
     symtable_set(func->base.name, VALUE_OBJ(func));
+    return func;
+}
+
+static void parse_func_body(struct bytecode_chunk* chunk, obj_function_t* func){
+    func->entry_offset = bcchunk_get_codesize(chunk);
+    profile_begin_function(func, NULL);
+    bcchunk_write_argument_check(func, chunk, line_counter);
+    memo_func = func->memo != NULL ? func : NULL;
     read_block(chunk);
     function_return_stub(chunk);
+    memo_func = NULL;
+    func->is_pure = bcchunk_is_pure(chunk, func->entry_offset, func);
 }
 
 static void parse_func_declaration(obj_function_t* func){
@@ -582,10 +979,19 @@ static void parse_return(struct bytecode_chunk* chunk){
         bcchunk_write_expression(expr, chunk, line_counter);
         ast_freenode(expr);
     }
-    bcchunk_write_simple_op(chunk, OP_RETURN,line_counter);
+    write_return(chunk);
     cur_expect(T_SEMI, "Expected ';'\n");
 }
 
+static void write_return(struct bytecode_chunk* chunk){
+    if(memo_func != NULL){
+        bcchunk_write_simple_op(chunk, OP_MEMO_RETURN, line_counter);
+        bcchunk_write_value(chunk, VALUE_OBJ(memo_func), line_counter);
+    }else{
+        bcchunk_write_simple_op(chunk, OP_RETURN, line_counter);
+    }
+}
+
 static void parse_class_declaration(struct bytecode_chunk* chunk){
     next_expect(T_IDENT, "Expected identifier\n");
     obj_class_t* cl = mk_objclass(cur_token.data.ptr);
@@ -612,6 +1018,9 @@ static void parse_constructor(struct bytecode_chunk* chunk){
     p->entry_offset = bcchunk_get_codesize(chunk);
     scope_add_constructor_data(chunk);
     p->base.argc = count_func_args();
+    p->arg_types = scope_get_argument_types();
+    profile_begin_function(p, scope_get_class());
+    bcchunk_write_argument_check(p, chunk, line_counter);
     cur_expect(T_RPAR, "Expected ')'\n");
 
     next_expect(T_LBRACE, "Expected '{'\n");
@@ -667,9 +1076,11 @@ static void parse_class_meth(obj_class_t* cl, struct bytecode_chunk* chunk){
 
     p->entry_offset = bcchunk_get_codesize(chunk);
     p->base.argc = argc;
-    bcchunk_write_simple_op(chunk, OP_GET_LOCAL, line_counter);
-    bcchunk_write_value(chunk, VALUE_NUMBER(-3 - argc), line_counter);//caller
-    scope_add_instance_data(chunk, argc);
+    p->arg_types = scope_get_argument_types();
+    scope_add_instance_data(chunk, argc); //caller
+    profile_begin_function(p, cl);
+
+    bcchunk_write_argument_check(p, chunk, line_counter);
     if(!table_set(cl->methods,p->base.name,VALUE_OBJ(p)) && !is_override)
         compile_error_printf("Method '%s' already exists\n", p->base.name->str);
 
@@ -701,7 +1112,7 @@ static void add_def_constructor(struct bytecode_chunk* chunk, obj_class_t* cl){
 
 static void function_return_stub(struct bytecode_chunk* chunk){
     bcchunk_write_simple_op(chunk, OP_NONE, line_counter);
-    bcchunk_write_simple_op(chunk, OP_RETURN, line_counter); // in case if user doesn't write 'return' implicitly
+    write_return(chunk); // in case if user doesn't write 'return' implicitly
 }
 
 static void parse_class_parents(obj_class_t* cl){
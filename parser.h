@@ -10,5 +10,9 @@ struct bytecode_chunk;
 ast_node* ast_process_expr();
 
 bool parse_command(struct bytecode_chunk* chunk);
+//bodies of functions are skipped by brace matching and compiled on the first call
+void parser_set_lazy(bool is_lazy);
+//compiles the skipped body at the end of the chunk, return false if the function has no such body
+bool parse_lazy_function(struct bytecode_chunk* chunk, obj_function_t* func);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,314 @@
+#include "profile.h"
+#include "hash_table.h"
+#include "lang_types.h"
+#include "symtable.h"
+#include "utils.h"
+#include <string.h>
+
+extern struct hash_table symtable;
+
+#define PROFILE_SOURCE_EXT ".enma"
+#define PROFILE_NAME_SIZE (1024)
+#define PROFILE_LINE_SIZE (3 * PROFILE_NAME_SIZE)
+
+struct calls_entry{
+    char* name;
+    uint32_t calls;
+};
+
+struct site_entry{
+    char* function;
+    profile_site kind;
+    int index;
+    char* class_name;
+};
+
+//the profile that is read from the file, entries are sorted by names of functions
+static struct{
+    struct calls_entry* calls;
+    size_t calls_count;
+    struct site_entry* sites;
+    size_t sites_count;
+}profile = {.calls = NULL, .calls_count = 0, .sites = NULL, .sites_count = 0};
+
+//the function that is being compiled and count of its sites of every kind
+static struct{
+    const obj_function_t* func;
+    const obj_class_t* cl;
+    int sites[PROFILE_SITE_KINDS];
+}compiled = {.func = NULL, .cl = NULL};
+
+//classes seen by the instructions of the running chunk, indexed by offset in the code
+static const obj_class_t** seen = NULL;
+static size_t seen_capacity = 0;
+//the site saw instances of different classes
+static const obj_class_t polymorphic_site;
+
+static const char* site_names[] = {
+    [PROFILE_METHOD_SITE] = "method",
+    [PROFILE_FIELD_SITE] = "field"
+};
+
+struct named_function{
+    obj_function_t* func;
+    char* name;
+};
+
+//all functions with their names, a function may have several names if it is inherited
+struct function_list{
+    struct named_function* funcs;
+    size_t count;
+    size_t capacity;
+};
+
+typedef void (*function_visitor)(obj_function_t* func, const char* name, void* ctx);
+
+//calls the visitor for every function in the symtable and in classes with its name in the profile
+static void visit_functions(function_visitor visit, void* ctx);
+static void visit_function(obj_function_t* func, const obj_class_t* cl, function_visitor visit, void* ctx);
+static void function_name(const obj_function_t* func, const obj_class_t* cl, char* name);
+static void collect_function(obj_function_t* func, const char* name, void* ctx);
+static void set_calls(obj_function_t* func, const char* name, void* ctx);
+static void read_line(const char* line);
+//writes the sites of code of the functions with the same entry
+static void save_sites(FILE* fp, const struct bytecode_chunk* chunk, const struct named_function* funcs, size_t count, int end);
+static int compare_calls(const void* a, const void* b);
+static int compare_sites(const void* a, const void* b);
+static int compare_entries(const void* a, const void* b);
+static char* copy_string(const char* str);
+
+char* profile_path(const char* source_path){
+    size_t len = strlen(source_path);
+    size_t ext_len = strlen(PROFILE_SOURCE_EXT);
+    char* path = emalloc(len + ext_len + 2);
+    if(len > ext_len && strcmp(source_path + len - ext_len, PROFILE_SOURCE_EXT) == 0)
+        sprintf(path, "%sp", source_path);
+    else
+        sprintf(path, "%s%sp", source_path, PROFILE_SOURCE_EXT);
+    return path;
+}
+
+bool profile_load(const char* path){
+    profile_free();
+    FILE* fp = path != NULL ? fopen(path, "r") : NULL;
+    if(fp == NULL)
+        return false;
+    char line[PROFILE_LINE_SIZE];
+    while(fgets(line, sizeof(line), fp) != NULL)
+        read_line(line);
+    fclose(fp);
+    qsort(profile.calls, profile.calls_count, sizeof(struct calls_entry), compare_calls);
+    qsort(profile.sites, profile.sites_count, sizeof(struct site_entry), compare_sites);
+    return true;
+}
+
+void profile_free(){
+    for(size_t i = 0; i < profile.calls_count; i++)
+        free(profile.calls[i].name);
+    for(size_t i = 0; i < profile.sites_count; i++){
+        free(profile.sites[i].function);
+        free(profile.sites[i].class_name);
+    }
+    free(profile.calls);
+    free(profile.sites);
+    profile.calls = NULL;
+    profile.sites = NULL;
+    profile.calls_count = profile.sites_count = 0;
+    free(seen);
+    seen = NULL;
+    seen_capacity = 0;
+}
+
+void profile_set_calls(){
+    //counts of calls that are evaluated at compile time are dropped too
+    visit_functions(set_calls, NULL);
+}
+
+void profile_begin_function(const obj_function_t* func, const obj_class_t* cl){
+    compiled.func = func;
+    compiled.cl = cl;
+    for(int i = 0; i < PROFILE_SITE_KINDS; i++)
+        compiled.sites[i] = 0;
+}
+
+obj_class_t* profile_next_site(profile_site kind){
+    //sites are numbered even if there is no profile
+    int index = compiled.sites[kind]++;
+    if(compiled.func == NULL || profile.sites_count == 0)
+        return NULL;
+    char name[PROFILE_NAME_SIZE];
+    function_name(compiled.func, compiled.cl, name);
+    struct site_entry key = {.function = name, .kind = kind, .index = index};
+    const struct site_entry* e = bsearch(&key, profile.sites, profile.sites_count, sizeof(struct site_entry), compare_sites);
+    if(e == NULL)
+        return NULL;
+    //the class may be renamed or removed since the profiled run
+    size_t len = strlen(e->class_name);
+    obj_id_t* id = table_find_string(&symtable, e->class_name, len, hash_string(e->class_name, len));
+    value_t val;
+    if(id == NULL || !symtable_get(id, &val) || !IS_OBJCLASS(val))
+        return NULL;
+    return AS_OBJCLASS(val);
+}
+
+void profile_record_site(int offset, const obj_class_t* cl){
+    if((size_t)offset >= seen_capacity){
+        size_t capacity = seen_capacity * 2 > (size_t)offset ? seen_capacity * 2 : (size_t)offset + 1024;
+        seen = erealloc(seen, sizeof(obj_class_t*) * capacity);
+        memset(seen + seen_capacity, 0, sizeof(obj_class_t*) * (capacity - seen_capacity));
+        seen_capacity = capacity;
+    }
+    if(seen[offset] == NULL)
+        seen[offset] = cl;
+    else if(seen[offset] != cl)
+        seen[offset] = &polymorphic_site;
+}
+
+bool profile_save(const char* path, const struct bytecode_chunk* chunk){
+    FILE* fp = fopen(path, "w");
+    if(fp == NULL){
+        dprintf("Profile: failed to create %s\n", path);
+        return false;
+    }
+    struct function_list list = {.funcs = NULL, .count = 0, .capacity = 0};
+    visit_functions(collect_function, &list);
+    for(size_t i = 0; i < list.count; i++)
+        if(list.funcs[i].func->calls > 0)
+            fprintf(fp, "%lu %s\n", (unsigned long)list.funcs[i].func->calls, list.funcs[i].name);
+
+    //code of a function lasts until the next entry
+    qsort(list.funcs, list.count, sizeof(struct named_function), compare_entries);
+    for(size_t i = 0, next; i < list.count; i = next){
+        for(next = i + 1; next < list.count && list.funcs[next].func->entry_offset == list.funcs[i].func->entry_offset; next++);
+        if(list.funcs[i].func->entry_offset < 0)
+            continue;
+        int end = next < list.count ? list.funcs[next].func->entry_offset : (int)chunk->_code.size;
+        save_sites(fp, chunk, list.funcs + i, next - i, end);
+    }
+    for(size_t i = 0; i < list.count; i++)
+        free(list.funcs[i].name);
+    free(list.funcs);
+
+    bool is_ok = !ferror(fp);
+    return fclose(fp) == 0 && is_ok;
+}
+
+static void visit_functions(function_visitor visit, void* ctx){
+    for(size_t i = 0; i < symtable.capacity; i++){
+        const hash_entry* e = &symtable.entries[i];
+        if(e->key == NULL)
+            continue;
+        //a global may hold a function under another name
+        if(IS_OBJFUNCTION(e->value) && AS_OBJFUNCTION(e->value)->base.name == e->key){
+            visit_function(AS_OBJFUNCTION(e->value), NULL, visit, ctx);
+        }else if(IS_OBJCLASS(e->value) && AS_OBJCLASS(e->value)->name == e->key){
+            const obj_class_t* cl = AS_OBJCLASS(e->value);
+            for(int j = 0; j <= CONSTRUCTORS_LIMIT && cl->constructors[j] != NULL; j++)
+                visit_function(cl->constructors[j], cl, visit, ctx);
+            for(size_t j = 0; j < cl->methods->capacity; j++)
+                if(cl->methods->entries[j].key != NULL && IS_OBJFUNCTION(cl->methods->entries[j].value))
+                    visit_function(AS_OBJFUNCTION(cl->methods->entries[j].value), cl, visit, ctx);
+        }
+    }
+}
+
+static void visit_function(obj_function_t* func, const obj_class_t* cl, function_visitor visit, void* ctx){
+    char name[PROFILE_NAME_SIZE];
+    function_name(func, cl, name);
+    visit(func, name, ctx);
+}
+
+static void function_name(const obj_function_t* func, const obj_class_t* cl, char* name){
+    if(cl != NULL)
+        snprintf(name, PROFILE_NAME_SIZE, "%s.%s/%d", cl->name->str, func->base.name->str, func->base.argc);
+    else
+        snprintf(name, PROFILE_NAME_SIZE, "%s/%d", func->base.name->str, func->base.argc);
+}
+
+static void collect_function(obj_function_t* func, const char* name, void* ctx){
+    struct function_list* list = ctx;
+    if(list->count == list->capacity){
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->funcs = erealloc(list->funcs, sizeof(struct named_function) * list->capacity);
+    }
+    list->funcs[list->count++] = (struct named_function){.func = func, .name = copy_string(name)};
+}
+
+static void set_calls(obj_function_t* func, const char* name, void* ctx){
+    (void)ctx;
+    struct calls_entry key = {.name = (char*)name};
+    const struct calls_entry* e = profile.calls_count > 0 ?
+        bsearch(&key, profile.calls, profile.calls_count, sizeof(struct calls_entry), compare_calls) : NULL;
+    func->calls = e != NULL ? e->calls : 0;
+}
+
+//damaged lines are skipped
+static void read_line(const char* line){
+    char kind[16], name[PROFILE_NAME_SIZE], class_name[PROFILE_NAME_SIZE];
+    unsigned long calls;
+    int index;
+    if(sscanf(line, "%lu %1023s", &calls, name) == 2){
+        if(profile.calls_count % 64 == 0)
+            profile.calls = erealloc(profile.calls, sizeof(struct calls_entry) * (profile.calls_count + 64));
+        profile.calls[profile.calls_count++] = (struct calls_entry){.name = copy_string(name),
+            .calls = calls > UINT32_MAX ? UINT32_MAX : calls};
+        return;
+    }
+    if(sscanf(line, "%15s %1023s %d %1023s", kind, name, &index, class_name) != 4 || index < 0)
+        return;
+    for(int i = 0; i < PROFILE_SITE_KINDS; i++){
+        if(strcmp(kind, site_names[i]) != 0)
+            continue;
+        if(profile.sites_count % 64 == 0)
+            profile.sites = erealloc(profile.sites, sizeof(struct site_entry) * (profile.sites_count + 64));
+        profile.sites[profile.sites_count++] = (struct site_entry){.function = copy_string(name), .kind = i,
+            .index = index, .class_name = copy_string(class_name)};
+    }
+}
+
+static void save_sites(FILE* fp, const struct bytecode_chunk* chunk, const struct named_function* funcs, size_t count, int end){
+    int sites[PROFILE_SITE_KINDS] = {0};
+    for(int offset = funcs[0].func->entry_offset; offset < end; offset += bcchunk_instruction_size(chunk->_code.data[offset])){
+        profile_site kind;
+        switch((op_t)chunk->_code.data[offset]){
+            case OP_METHOD: case OP_INVOKE: kind = PROFILE_METHOD_SITE; break;
+            case OP_GET_FIELD: kind = PROFILE_FIELD_SITE; break;
+            default: continue;
+        }
+        int index = sites[kind]++;
+        const obj_class_t* cl = (size_t)offset < seen_capacity ? seen[offset] : NULL;
+        if(cl == NULL || cl == &polymorphic_site)
+            continue;
+        for(size_t i = 0; i < count; i++)
+            fprintf(fp, "%s %s %d %s\n", site_names[kind], funcs[i].name, index, cl->name->str);
+    }
+}
+
+static int compare_calls(const void* a, const void* b){
+    return strcmp(((const struct calls_entry*)a)->name, ((const struct calls_entry*)b)->name);
+}
+
+static int compare_sites(const void* a, const void* b){
+    const struct site_entry* s1 = a;
+    const struct site_entry* s2 = b;
+    int cmp = strcmp(s1->function, s2->function);
+    if(cmp != 0)
+        return cmp;
+    if(s1->kind != s2->kind)
+        return s1->kind < s2->kind ? -1 : 1;
+    return s1->index < s2->index ? -1 : s1->index > s2->index;
+}
+
+static int compare_entries(const void* a, const void* b){
+    const struct named_function* f1 = a;
+    const struct named_function* f2 = b;
+    if(f1->func->entry_offset != f2->func->entry_offset)
+        return f1->func->entry_offset < f2->func->entry_offset ? -1 : 1;
+    return strcmp(f1->name, f2->name);
+}
+
+static char* copy_string(const char* str){
+    char* copy = emalloc(strlen(str) + 1);
+    strcpy(copy, str);
+    return copy;
+}
@@ -0,0 +1,45 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "bytecode.h"
+#include "lang_types.h"
+
+/*
+With --profile the run records counts of calls of all functions and classes of receivers
+at method calls and field reads, they are saved next to the source (prog.enma -> prog.enmap).
+Lines of the file:
+ - 'count name' - count of calls, name is 'function/argc' or 'Class.method/argc' for methods and constructors
+ - 'method name index Class', 'field name index Class' - the receiver at the index-th method call
+   or field read of the function always was an instance of Class
+The next compilations read the profile: dead code elimination places the code of hot functions first,
+the compiler writes method calls as OP_INVOKE and field reads as OP_GET_PATH with the cached class.
+Both are guarded by the class, so a wrong profile only makes the site look the member up again.
+*/
+
+typedef enum{
+    PROFILE_METHOD_SITE,
+    PROFILE_FIELD_SITE,
+    PROFILE_SITE_KINDS
+}profile_site;
+
+//return path of the profile for the source, it must be freed
+char* profile_path(const char* source_path);
+//reads the profile before the compilation, path may be NULL
+//return false if there is no profile
+bool profile_load(const char* path);
+void profile_free();
+//sets counts of calls of functions in the symtable from the profile, others are 0
+void profile_set_calls();
+//the compiler starts the body of the function, cl is NULL if it is not a method or a constructor
+void profile_begin_function(const obj_function_t* func, const obj_class_t* cl);
+//return the class that was seen at the next site of the function, NULL if it is not known
+obj_class_t* profile_next_site(profile_site kind);
+//the instruction at the offset in the code saw an instance of the class
+void profile_record_site(int offset, const obj_class_t* cl);
+//writes counts of calls and sites of the chunk that saw one class, return false if the file cannot be written
+bool profile_save(const char* path, const struct bytecode_chunk* chunk);
+
+#endif
@@ -5,46 +5,83 @@
 #include "utils.h"
 #include "symtable.h"
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 static int is_putback = 0;
+//count of '${' in strings that are not closed yet
+static int interp_depth = 0;
 struct token cur_token;
 int line_counter = 1;
 
-#define INPUT_BUF_SZ (16)
 #define WORD_SIZE (1024)
 
-static FILE* _scan_fp = NULL;
+//the whole file is read in memory, so a character is got without a call to the stream
+struct _source{
+    char* data;
+    size_t size;
+    size_t pos;
+};
+static struct _source _src = {.data = NULL, .size = 0, .pos = 0};
 
-struct _input_buf{
-    int sz;
-    int buf[INPUT_BUF_SZ];
-}_input_buf;
+#define IMPORT_DEPTH (32)
+
+//state of the file that imports the one being scanned
+struct _import_frame{
+    struct _source src;
+    const char* path;
+    int line;
+    char* name; //as it is written in the import
+};
+
+//the main file is not on the stack
+static struct _import_frame _imports[IMPORT_DEPTH];
+static int _imports_depth = 0;
+//real path of the file that is being scanned, it is one of _files
+static const char* _scan_path = NULL;
+//real paths of the main file and all imported ones, every file is scanned once
+static char** _files = NULL;
+static int _files_count = 0;
 
 static inline int _get(); //return character in the stream
 static inline int _skip(); //skip spaces and return the last character
 static inline int _skip_until(int c); //skip all the characters until 'c' character or EOF, return 'c' or EOF
-static inline void _putback(int c); //puts character back in the stream
+static inline void _putback(int c); //puts the last read character back in the stream
 static inline int _readint(int c); // last character in the stream must be a digit
 static inline char* _readword(int c, size_t* sz); //first character must be alphabetical, return string and the size
-//reads until '\"' or EOF and return a string, last character is put in the stream
+//reads until '\"', '${' or EOF and return a string, last character is put in the stream
 //writes size of the string in the sz
 static inline char* _readstring(size_t* sz);
+//reads a string or its part before '${' in cur_token
+static void _scan_string_part(bool is_continued);
+//return real path of the file, it must be freed
+static char* _resolve_path(const char* path);
+static bool _add_file(char* real_path);
+static struct _source _read_source(FILE* fp);
 
 static inline int _get(){
-    int c = _input_buf.sz > 0 ? _input_buf.buf[--_input_buf.sz] : getc(_scan_fp);
+    if(_src.pos >= _src.size)
+        return EOF;
+    int c = (unsigned char)_src.data[_src.pos++];
     if(c == '\n')
         ++line_counter ;
     return c;
 }
 
 static inline void _putback(int c){
-    if(_input_buf.sz >= INPUT_BUF_SZ)
-        fatal_printf("input buffer size limit exceeded!\n");
-    if((_input_buf.buf[_input_buf.sz++] = c) == '\n')
+    //EOF is got again
+    if(c == EOF)
+        return;
+#ifdef DEBUG
+    if(_src.pos == 0 || (unsigned char)_src.data[_src.pos - 1] != c)
+        fatal_printf("_putback(): only the last read character may be put back!\n");
+#endif
+    _src.pos--;
+    if(c == '\n')
         --line_counter;
 }
 
@@ -93,6 +130,12 @@ static inline char* _readstring(size_t* sz){
 
     int c;
     for(c = _get(); c != EOF && c != '\"'; c =_get()){
+        if(c == '$'){
+            int next = _get();
+            _putback(next);
+            if(next == '{')
+                break;
+        }
         if(capacity <= *sz)
             GROW_SIZE();
         if (c == '\\') {
@@ -103,6 +146,7 @@ static inline char* _readstring(size_t* sz){
                 case 't':   c = '\t'; break;
                 case '\'':  c = '\''; break;
                 case '\"':  c = '\"'; break;
+                case '$':   c = '$'; break;
                 case '?':   c = '\?'; break;
                 case 'a':   c = '\a'; break;
                 case 'b':   c = '\b'; break;
@@ -121,9 +165,149 @@ static inline char* _readstring(size_t* sz){
     #undef GROW_SIZE
 }
 
-void scanner_init(FILE* fp){
-    _scan_fp = fp;
+//the string continues after '}' if it is a part of interpolated string
+static void _scan_string_part(bool is_continued){
+    size_t sz;
+    char* str = _readstring(&sz);
+    int c = _get();
+    if(c == '$'){
+        _get(); //'{'
+        interp_depth++;
+        cur_token.type = T_INTERP;
+    }else if(c == '\"'){
+        cur_token.type = is_continued ? T_INTERP_END : T_STRING;
+    }else{
+        compile_error_printf("Unclosed '\"'\n");
+    }
+    int32_t hash = hash_string(str, sz);
+    cur_token.data.ptr = stringtable_findstr(str, sz, hash);
+}
+
+void scanner_init(FILE* fp, const char* path){
+    scanner_cleanup();
+    _src = _read_source(fp);
+    line_counter = 1;
+    char* real_path = _resolve_path(path);
+    _add_file(real_path);
+    _scan_path = real_path;
+}
+
+void scanner_cleanup(){
+    while(_imports_depth > 0)
+        scanner_end_import();
+    for(int i = 0; i < _files_count; i++)
+        free(_files[i]);
+    free(_files);
+    _files = NULL;
+    _files_count = 0;
+    _scan_path = NULL;
+    free(_src.data);
+    _src = (struct _source){.data = NULL, .size = 0, .pos = 0};
+}
+
+bool scanner_import(const char* path){
+    if(_imports_depth >= IMPORT_DEPTH)
+        compile_error_printf("Imports are nested deeper than %d files\n", IMPORT_DEPTH);
+    char* real_path;
+    //relative to the directory of the current file
+    const char* dir_end = path[0] != '/' ? strrchr(_scan_path, '/') : NULL;
+    if(dir_end != NULL){
+        int dir_len = dir_end - _scan_path;
+        char* full_path = emalloc(dir_len + strlen(path) + 2);
+        sprintf(full_path, "%.*s/%s", dir_len, _scan_path, path);
+        real_path = _resolve_path(full_path);
+        free(full_path);
+    }else{
+        real_path = _resolve_path(path);
+    }
+    FILE* fp = fopen(real_path, "r");
+    if(fp == NULL)
+        compile_error_printf("Failed to import '%s': %s\n", path, strerror(errno));
+    if(!_add_file(real_path)){
+        fclose(fp);
+        return false;
+    }
+    struct _import_frame* frame = &_imports[_imports_depth++];
+    *frame = (struct _import_frame){.src = _src, .path = _scan_path, .line = line_counter,
+        .name = emalloc(strlen(path) + 1)};
+    strcpy(frame->name, path);
+    _src = _read_source(fp);
+    fclose(fp);
+    _scan_path = real_path;
     line_counter = 1;
+    return true;
+}
+
+void scanner_end_import(){
+#ifdef DEBUG
+    if(_imports_depth == 0)
+        fatal_printf("scanner_end_import() is called in the main file!\n");
+#endif
+    struct _import_frame* frame = &_imports[--_imports_depth];
+    free(_src.data);
+    free(frame->name);
+    _src = frame->src;
+    _scan_path = frame->path;
+    line_counter = frame->line;
+}
+
+const char* scanner_import_name(){
+    return _imports_depth > 0 ? _imports[_imports_depth - 1].name : NULL;
+}
+
+char* const* scanner_files(int* count){
+    *count = _files_count;
+    return _files;
+}
+
+static struct _source _read_source(FILE* fp){
+    struct _source src = {.data = NULL, .size = 0, .pos = 0};
+    size_t capacity = 0;
+    do{
+        capacity += capacity + 4096;
+        src.data = erealloc(src.data, capacity);
+        src.size += fread(src.data + src.size, 1, capacity - src.size, fp);
+    }while(src.size == capacity);
+    if(ferror(fp))
+        fatal_printf("Failed to read the source file\n");
+    return src;
+}
+
+static char* _resolve_path(const char* path){
+    char* real_path = realpath(path, NULL);
+    if(real_path != NULL)
+        return real_path;
+    //the file is not found, fopen() reports the error
+    real_path = emalloc(strlen(path) + 1);
+    strcpy(real_path, path);
+    return real_path;
+}
+
+//return false if the file is already scanned, the path is freed then
+static bool _add_file(char* real_path){
+    for(int i = 0; i < _files_count; i++){
+        if(strcmp(_files[i], real_path) == 0){
+            free(real_path);
+            return false;
+        }
+    }
+    _files = erealloc(_files, sizeof(char*) * (_files_count + 1));
+    _files[_files_count++] = real_path;
+    return true;
+}
+
+struct scanner_position scanner_tell(){
+    return (struct scanner_position){.offset = _src.pos, .line = line_counter,
+        .interp_depth = interp_depth, .is_putback = is_putback};
+}
+
+void scanner_seek(struct scanner_position pos){
+    if(pos.offset < 0 || (size_t)pos.offset > _src.size)
+        fatal_printf("scanner_seek(): offset is out of the source\n");
+    _src.pos = pos.offset;
+    is_putback = pos.is_putback;
+    interp_depth = pos.interp_depth;
+    line_counter = pos.line;
 }
 
 void scanner_putback_token(){
@@ -145,6 +329,8 @@ int scanner_next_token(){
         case '+':{
             if((c = _get()) == '+'){
                 cur_token.type = T_INCR;
+            }else if(c == '='){
+                cur_token.type = T_ADD_ASSIGN;
             }else{
                 _putback(c);
                 cur_token.type = T_ADD;
@@ -154,6 +340,8 @@ int scanner_next_token(){
         case '-':{ 
             if((c = _get()) == '-'){
                 cur_token.type = T_DECR;
+            }else if(c == '='){
+                cur_token.type = T_SUB_ASSIGN;
             }else{
                 _putback(c);
                 cur_token.type = T_SUB;
@@ -168,6 +356,8 @@ int scanner_next_token(){
             }else if(c == '*'){
                 while(!((c = _get()) == '*' && (c = _get()) == '/'));
                 return scanner_next_token();
+            }else if(c == '='){
+                cur_token.type = T_DIV_ASSIGN; break;
             }else{
                 _putback(c);
                 cur_token.type = T_DIV; break;
@@ -177,7 +367,15 @@ int scanner_next_token(){
             _skip_until('\n');
             return scanner_next_token();
         }
-        case '*': cur_token.type = T_MUL; break;
+        case '*':{
+            if((c = _get()) == '='){
+                cur_token.type = T_MUL_ASSIGN;
+            }else{
+                cur_token.type = T_MUL;
+                _putback(c);
+            }
+            break;
+        }
         case '=':{
             if((c = _get()) == '='){
                 cur_token.type = T_EQUAL;
@@ -211,7 +409,16 @@ int scanner_next_token(){
         case ')': cur_token.type = T_RPAR; break;
         case ';': cur_token.type = T_SEMI; break;
         case '{': cur_token.type = T_LBRACE; break;
-        case '}': cur_token.type = T_RBRACE; break;
+        case '}':{
+            //the end of an interpolated expression, the string continues
+            if(interp_depth > 0){
+                interp_depth--;
+                _scan_string_part(true);
+            }else{
+                cur_token.type = T_RBRACE;
+            }
+            break;
+        }
         case ',': cur_token.type = T_COMMA; break;
         case '!':{
             if(_get() != '='){
@@ -220,16 +427,9 @@ int scanner_next_token(){
             cur_token.type = T_NEQUAL;
             break;
         }
-        case '\"':{
-            cur_token.type = T_STRING;
-            size_t sz;
-            char* str = _readstring(&sz);
-            if(_get() != '\"')
-                compile_error_printf("Unclosed '\"'\n");
-            int32_t hash = hash_string(str, sz);
-            cur_token.data.ptr = stringtable_findstr(str, sz, hash);
+        case '\"':
+            _scan_string_part(false);
             break;
-        }
         case EOF: cur_token.type = T_EOF; return 0;
         default:{
             if(isdigit(c)){
@@ -274,6 +474,10 @@ void scanner_debug_tokens(){
             case T_EQUAL: printf("'==' "); break;
             case T_NEQUAL: printf("'!=' "); break;
             case T_ASSIGN: printf("'=' "); break;
+            case T_ADD_ASSIGN: printf("'+=' "); break;
+            case T_SUB_ASSIGN: printf("'-=' "); break;
+            case T_MUL_ASSIGN: printf("'*=' "); break;
+            case T_DIV_ASSIGN: printf("'/=' "); break;
             case T_GREATER: printf("'>' "); break;
             case T_EGREATER: printf("'>=' "); break;
             case T_LESS: printf("'<' "); break;
@@ -281,6 +485,8 @@ void scanner_debug_tokens(){
             case T_LBRACE: printf("'{' "); break;
             case T_RBRACE: printf("'}' "); break;
             case T_STRING: printf("'\"%s\"' ", ((obj_string_t*)(cur_token.data.ptr))->str); break;
+            case T_INTERP: printf("'\"%s${' ", ((obj_string_t*)(cur_token.data.ptr))->str); break;
+            case T_INTERP_END: printf("'}%s\"' ", ((obj_string_t*)(cur_token.data.ptr))->str); break;
             case T_IDENT: printf("'%s' ", ((obj_string_t*)cur_token.data.ptr)->str); break;
             case T_VAR: printf("'var' "); break;
             case T_ELSE: printf("'else' "); break;
@@ -301,6 +507,14 @@ void scanner_debug_tokens(){
             case T_THIS: printf("'this' "); break;
             case T_COLON: printf("':' "); break;
             case T_OVERRIDE: printf("'override' "); break;
+            case T_SWITCH: printf("'switch' "); break;
+            case T_CASE: printf("'case' "); break;
+            case T_DEFAULT: printf("'default' "); break;
+            case T_TRY: printf("'try' "); break;
+            case T_CATCH: printf("'catch' "); break;
+            case T_THROW: printf("'throw' "); break;
+            case T_MEMO: printf("'memo' "); break;
+            case T_IMPORT: printf("'import' "); break;
             default:
                 fatal_printf("Undefined token in scanner_debug_tokens()!\n");
         }
@@ -1,10 +1,32 @@
 #ifndef SCANNER_H
 #define SCANNER_H
 
+#include <stdbool.h>
 #include <stdio.h>
 #include "token.h"
 
-void scanner_init(FILE* fp);
+//position in the source between tokens, a skipped part may be scanned again from it
+struct scanner_position{
+    long offset;
+    int line;
+    int interp_depth;
+    bool is_putback; //cur_token is put back, it is not changed by scanner_seek()
+};
+
+//the whole file is read in memory, imports are found relative to the path of the main file
+void scanner_init(FILE* fp, const char* path);
+void scanner_cleanup();
+//the next tokens are read from the imported file until its end, path is relative to the current file
+//return false if the file is already imported, then it is not scanned again
+bool scanner_import(const char* path);
+//closes the imported file, scanning continues after the import
+void scanner_end_import();
+//name of the imported file that is being scanned as it is written in the import, NULL in the main file
+const char* scanner_import_name();
+//real paths of the main file and all imported files, count is written in the count
+char* const* scanner_files(int* count);
+struct scanner_position scanner_tell();
+void scanner_seek(struct scanner_position pos);
 int scanner_next_token();
 //puts token and curent line in the buffer, may be got by scanner_next_token()
 void scanner_putback_token();
@@ -18,9 +18,14 @@ struct scope _scope = {
     .is_constructor = false
 };
 
+//annotated global variables, value is a number of static_type
+static struct hash_table global_types;
+//identifier of hidden locals, it cannot appear in the code
+static obj_id_t* hidden_id;
+
 //push it on the 'locals' stack
 //mark as undefined (depth = -1)
-static void declare_local(obj_id_t* id);
+static void declare_local(obj_id_t* id, static_type type);
 
 //mark 'top' local as defined by defining its depth
 static void define_local();
@@ -33,11 +38,14 @@ static void perform_local_global_op(struct bytecode_chunk* chunk, const obj_id_t
 static bool resolve_field(struct bytecode_chunk* chunk, const obj_id_t* id, int line, op_t op);
 
 static int find_argument(const obj_id_t* id);
+static struct local* find_local(const obj_id_t* id);
 
 void scope_init(){
     //garbage collector stores this memory
     _scope.this_ = mk_objid("this", strlen("this"), hash_string("this", strlen("this")));
     symtable_set(_scope.this_, VALUE_UNINIT);
+    table_init(&global_types);
+    hidden_id = mk_objid("hidden local", strlen("hidden local"), hash_string("hidden local", strlen("hidden local")));
 }
 
 void begin_scope(){
@@ -89,11 +97,31 @@ int count_scope_vars(){
     return res;
 }
 
-bool declare_variable(obj_id_t* id){
+int scope_get_locals_count(){
+    return _scope.locals_count;
+}
+
+int scope_add_hidden_local(static_type type){
+    declare_local(hidden_id, type);
+    define_local();
+    return _scope.locals_count - 1;
+}
+
+bool scope_add_pushed_local(obj_id_t* id){
+    if(check_current_depth_local(id))
+        return false;
+    declare_local(id, ST_ANY);
+    define_local();
+    return true;
+}
+
+bool declare_variable(obj_id_t* id, static_type type){
     if(check_current_depth_local(id))
         return false;
     if(!is_global_scope()){
-        declare_local(id);
+        declare_local(id, type);
+    }else if(type != ST_ANY){
+        table_set(&global_types, id, VALUE_NUMBER(type));
     }
     //global variable is already in the symtable
     //it is marked as VT_NULL value
@@ -107,9 +135,15 @@ bool define_variable(obj_id_t* id, struct ast_node* expr, struct bytecode_chunk*
             compile_error_printf("Identifier '%s' is not in symtable! Some shit has occured!\n", id->str);
         if(!IS_NONE(val))
             compile_error_printf("'%s' variable redefenition.\n", id->str);
-        symtable_set(id, ast_eval(expr));
+        val = ast_eval(expr);
+        static_type type = scope_get_type(id);
+        if(!is_value_static_type(val, type))
+            compile_error_printf("'%s' must be initialized with a value of type '%s'\n", id->str, get_static_type_name(type));
+        symtable_set(id, val);
     }else{
         bcchunk_write_expression(expr, chunk, line_counter);
+        bcchunk_write_type_check(expr, _scope.locals[_scope.locals_count-1].type, chunk, line_counter);
+        _scope.locals[_scope.locals_count-1].known_class = bcchunk_infer_class(expr);
         define_local();
         //local is just on the stack
         //bcchunk_write_simple_op(chunk, OP_DEFINE_LOCAL, line_counter);
@@ -118,12 +152,7 @@ bool define_variable(obj_id_t* id, struct ast_node* expr, struct bytecode_chunk*
 }
 
 static inline void pop_locals(struct bytecode_chunk* chunk, int var_k){
-    if(var_k == 1){
-        bcchunk_write_simple_op(chunk, OP_POP, line_counter);
-    }else if(var_k > 1){
-        bcchunk_write_simple_op(chunk, OP_POPN, line_counter);
-        bcchunk_write_constant(chunk, var_k, line_counter);
-    }
+    bcchunk_write_popn(chunk, var_k, line_counter);
 }
 
 static bool check_current_depth_local(obj_string_t* id){
@@ -134,11 +163,13 @@ static bool check_current_depth_local(obj_string_t* id){
     return false;
 }
 
-static void declare_local(obj_id_t* id){
+static void declare_local(obj_id_t* id, static_type type){
     if(_scope.locals_count >= LOCALS_COUNT)
         compile_error_printf("Locals number has reached limit!\n");
     _scope.locals[_scope.locals_count].depth = -1;
     _scope.locals[_scope.locals_count].id = id;
+    _scope.locals[_scope.locals_count].type = type;
+    _scope.locals[_scope.locals_count].known_class = NULL;
     ++_scope.locals_count;
 }
 
@@ -158,33 +189,87 @@ bool scope_is_constructor(){
     return _scope.is_constructor;
 }
 void scope_add_constructor_data(struct bytecode_chunk* chunk){
-    declare_local(_scope.this_); //this argument is an instance that uses this method
+    declare_local(_scope.this_, ST_ANY); //this argument is an instance that uses this method
+    _scope.locals[_scope.locals_count-1].known_class = _scope.current_class;
     define_local();
     bcchunk_write_simple_op(chunk, OP_INSTANCE, line_counter);
     bcchunk_write_value(chunk, VALUE_OBJ(_scope.current_class), line_counter);
 }
 
 void scope_add_instance_data(struct bytecode_chunk* chunk, int argc){
-    declare_local(_scope.this_); //this argument is an instance that uses this method
+    declare_local(_scope.this_, ST_ANY); //this argument is an instance that uses this method
+    //it may be an instance of a derived class, calls are guarded
+    _scope.locals[_scope.locals_count-1].known_class = _scope.current_class;
     define_local();
-    bcchunk_write_simple_op(chunk, OP_GET_LOCAL, line_counter);
-    bcchunk_write_value(chunk, VALUE_NUMBER(-3-argc), line_counter);
+    bcchunk_write_local_op(chunk, OP_GET_LOCAL, -3-argc, line_counter);
 }
 
 obj_id_t* scope_get_this(){
     return _scope.this_;
 }
 
-void declare_argument(obj_id_t* id){
+void declare_argument(obj_id_t* id, static_type type){
     if(_scope.current_class != NULL && table_check(_scope.current_class->fields, id, NULL))
         compile_error_printf("'%s' is a class field\n", id->str);
     if(find_argument(id) != -1)
         compile_error_printf("Argument '%s' has already defined\n", id->str);
     if(_scope.arguments_count >= ARGUMENTS_COUNT)
         compile_error_printf("Arguments number has reached limit!\n");
+    _scope.argument_types[_scope.arguments_count] = type;
     _scope.arguments[_scope.arguments_count++] = id;
 }
 
+static_type scope_get_type(const obj_id_t* id){
+    if(_scope.current_class != NULL && table_check(_scope.current_class->fields, id, NULL))
+        return ST_ANY;
+    if(!is_global_scope()){
+        int idx = find_argument(id);
+        if(idx != -1)
+            return _scope.argument_types[idx];
+        for(int i = _scope.locals_count - 1; i >= 0; i--)
+            if(is_equal_objstring(_scope.locals[i].id, id))
+                return _scope.locals[i].type;
+    }
+    value_t val;
+    if(table_check(&global_types, id, &val))
+        return AS_NUMBER(val);
+    return ST_ANY;
+}
+
+obj_class_t* scope_get_known_class(const obj_id_t* id){
+    struct local* p = find_local(id);
+    return p ? p->known_class : NULL;
+}
+
+void scope_update_known_class(const obj_id_t* id, obj_class_t* cl){
+    struct local* p = find_local(id);
+    if(p && p->known_class != cl)
+        p->known_class = NULL;
+}
+
+//return NULL if it is not a local or it is shadowed by an argument or a field
+static struct local* find_local(const obj_id_t* id){
+    if(is_global_scope() || find_argument(id) != -1)
+        return NULL;
+    if(_scope.current_class != NULL && table_check(_scope.current_class->fields, id, NULL))
+        return NULL;
+    for(int i = _scope.locals_count - 1; i >= 0; i--)
+        if(is_equal_objstring(_scope.locals[i].id, id))
+            return &_scope.locals[i];
+    return NULL;
+}
+
+static_type* scope_get_argument_types(){
+    int i = 0;
+    for(; i < _scope.arguments_count && _scope.argument_types[i] == ST_ANY; i++);
+    if(i == _scope.arguments_count)
+        return NULL;
+    static_type* types = emalloc(sizeof(types[0]) * _scope.arguments_count);
+    for(i = 0; i < _scope.arguments_count; i++)
+        types[i] = _scope.argument_types[i];
+    return types;
+}
+
 int resolve_local(const obj_id_t* id){
     int idx = find_argument(id);
     if(idx != -1)
@@ -198,11 +283,20 @@ int resolve_local(const obj_id_t* id){
     return -1;
 }
 
+bool scope_is_field(const obj_id_t* id){
+    return _scope.current_class != NULL && table_check(_scope.current_class->fields, id, NULL);
+}
+
+int scope_resolve_slot(const obj_id_t* id){
+    if(is_global_scope() || (_scope.current_class != NULL && table_check(_scope.current_class->fields, id, NULL)))
+        return -1;
+    return resolve_local(id);
+}
+
 static void perform_local_global_op(struct bytecode_chunk* chunk, const obj_id_t* id, op_t local, op_t global, int line){
     int idx;
     if(!is_global_scope() && (idx = resolve_local(id)) != -1){
-            bcchunk_write_simple_op(chunk, local, line);
-            bcchunk_write_value(chunk, VALUE_NUMBER(idx), line);
+            bcchunk_write_local_op(chunk, local, idx, line);
     }else{
         bcchunk_write_simple_op(chunk, global, line);
         bcchunk_write_value(chunk, VALUE_OBJ(id), line);
@@ -225,6 +319,10 @@ static bool resolve_field(struct bytecode_chunk* chunk, const obj_id_t* id, int
 
     if(table_check(_scope.current_class->fields, id, NULL)){
         write_get_var(chunk, _scope.this_, line);
+        if(op == OP_GET_FIELD){
+            bcchunk_write_get_field(chunk, (obj_id_t*)id, line);
+            return true;
+        }
         bcchunk_write_simple_op(chunk, op, line);
         bcchunk_write_value(chunk, VALUE_OBJ(id), line);
         return true;
@@ -233,6 +331,11 @@ static bool resolve_field(struct bytecode_chunk* chunk, const obj_id_t* id, int
     return false;
 }
 
+void write_compound_assign_var(struct bytecode_chunk* chunk, const obj_id_t* id, op_t local, op_t global, op_t field, int line){
+    if(!resolve_field(chunk, id, line, field))
+        perform_local_global_op(chunk, id, local, global, line);
+}
+
 void write_postincr_var(struct bytecode_chunk* chunk, const obj_id_t* id, int line){
     perform_local_global_op(chunk, id, OP_POSTINCR_LOCAL, OP_POSTINCR_GLOBAL, line);
 }
@@ -14,6 +14,8 @@ struct ast_node;
 struct local{
     obj_id_t* id;
     int depth;
+    static_type type;
+    obj_class_t* known_class; //class of the instance if it is known at compile time
 };
 
 struct scope{
@@ -21,6 +23,7 @@ struct scope{
     int locals_count;
 
     obj_id_t* arguments[ARGUMENTS_COUNT];
+    static_type argument_types[ARGUMENTS_COUNT];
     int arguments_count;
 
     int current_depth;
@@ -53,22 +56,46 @@ int get_scope();
 
 //return count of the variables in the current scope
 int count_scope_vars();
+//return count of the locals in all scopes of the function
+int scope_get_locals_count();
+//defines a local that cannot be referenced by name, its value must be on the stack
+//return its index for vm.bp[]
+int scope_add_hidden_local(static_type type);
+//defines a local of the current scope, its value is pushed by the VM(caught exception)
+//return false if variable exists
+bool scope_add_pushed_local(obj_id_t* id);
 
 /*return false if variable exists*/
-bool declare_variable(obj_id_t* id);
+bool declare_variable(obj_id_t* id, static_type type);
 /*return false if variable exists*/
 bool define_variable(obj_id_t* id, struct ast_node* expr, struct bytecode_chunk* chunk);
 /*return false if variable exists*/
-void declare_argument(obj_id_t* id);
+void declare_argument(obj_id_t* id, static_type type);
+
+//return annotated type of a local, an argument or a global variable
+//return ST_ANY if it is not annotated or it is a class field
+static_type scope_get_type(const obj_id_t* id);
+//return class of the local instance if it is known at compile time, NULL otherwise
+obj_class_t* scope_get_known_class(const obj_id_t* id);
+//local is reassigned, forget its class if it may be different
+void scope_update_known_class(const obj_id_t* id, obj_class_t* cl);
+//return copy of the current argument types or NULL if none of them is annotated
+static_type* scope_get_argument_types();
 
 //return variable index for vm.bp[]
 //return -1 if not found(vm.bp[-1] is old bp and vm.bp[-2] is return address)
 //print error if try to resolve currently defining variable
 //resolve locals and arguments
 int resolve_local(const obj_id_t* id);
+//return true if the identifier is a field of the current class
+bool scope_is_field(const obj_id_t* id);
+//the same as resolve_local(), but return -1 if the identifier is a class field
+int scope_resolve_slot(const obj_id_t* id);
 
 void write_set_var(struct bytecode_chunk* chunk, const obj_id_t* id, int line);
 void write_get_var(struct bytecode_chunk* chunk, const obj_id_t* id, int line);
+//writes OP_*_ASSIGN_LOCAL, OP_*_ASSIGN_GLOBAL or OP_*_ASSIGN_FIELD for a class field
+void write_compound_assign_var(struct bytecode_chunk* chunk, const obj_id_t* id, op_t local, op_t global, op_t field, int line);
 void write_postincr_var(struct bytecode_chunk* chunk, const obj_id_t* id, int line);
 void write_prefincr_var(struct bytecode_chunk* chunk, const obj_id_t* id, int line);
 void write_postdecr_var(struct bytecode_chunk* chunk, const obj_id_t* id, int line);
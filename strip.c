@@ -0,0 +1,383 @@
+#include "strip.h"
+#include "hash_table.h"
+#include "symtable.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+extern struct hash_table symtable;
+
+struct stripper{
+    struct bytecode_chunk* chunk;
+    obj_function_t** funcs; //functions with code sorted by entry offset
+    int* starts;            //entry offsets before the compaction
+    bool* is_live;
+    int funcs_count;
+    int funcs_capacity;
+    int* work;              //indices of live functions that are not scanned yet
+    int work_count;
+    const obj_class_t** classes; //live classes
+    int classes_count;
+    int classes_capacity;
+};
+
+//code of a live function in the compacted chunk
+struct placement{
+    int idx;         //the first function with the entry
+    int start;
+    uint32_t calls;  //of all functions with the entry
+};
+
+static bool collect_functions(struct stripper* s);
+static void add_function(struct stripper* s, obj_function_t* func);
+static void add_class_functions(struct stripper* s, const obj_class_t* cl);
+static int compare_functions(const void* a, const void* b);
+static int find_function(const struct stripper* s, int offset);
+static inline int function_end(const struct stripper* s, int idx);
+static void mark_function(struct stripper* s, const obj_function_t* func);
+static void mark_class(struct stripper* s, const obj_class_t* cl);
+static void mark_value(struct stripper* s, value_t val);
+static void mark_globals(struct stripper* s);
+static void scan_function(struct stripper* s, int idx);
+static int compact(struct stripper* s);
+static int compare_placements(const void* a, const void* b);
+//return index of the first run that starts after the offset
+static size_t find_run(const struct line_run* runs, size_t count, int offset);
+static inline void add_run(struct line_run* runs, size_t* count, int offset, int line);
+static void remove_dead_classes(const struct stripper* s);
+static inline int read_operand(const struct bytecode_chunk* chunk, int offset, int idx);
+static inline union _inner_value_t read_data(const struct bytecode_chunk* chunk, int offset, int idx);
+
+int bcchunk_strip(struct bytecode_chunk* chunk, obj_function_t* entry){
+    struct stripper s = {.chunk = chunk};
+    if(entry->entry_offset < 0 || !collect_functions(&s)){
+        free(s.funcs);
+        return 0;
+    }
+    s.starts = emalloc(sizeof(int) * (s.funcs_count + 1));
+    s.is_live = emalloc(sizeof(bool) * (s.funcs_count + 1));
+    s.work = emalloc(sizeof(int) * (s.funcs_count + 1));
+    for(int i = 0; i < s.funcs_count; i++){
+        s.starts[i] = s.funcs[i]->entry_offset;
+        s.is_live[i] = false;
+    }
+
+    mark_function(&s, entry);
+    mark_globals(&s);
+    while(s.work_count > 0)
+        scan_function(&s, s.work[--s.work_count]);
+    int removed = compact(&s);
+    remove_dead_classes(&s);
+
+    free(s.funcs);
+    free(s.starts);
+    free(s.is_live);
+    free(s.work);
+    free(s.classes);
+    return removed;
+}
+
+//functions are found in the symtable, in classes and in operands of the code
+//return false if the code contains an unknown instruction
+static bool collect_functions(struct stripper* s){
+    for(size_t i = 0; i < symtable.capacity; i++){
+        if(symtable.entries[i].key == NULL)
+            continue;
+        value_t val = symtable.entries[i].value;
+        if(IS_OBJFUNCTION(val))
+            add_function(s, AS_OBJFUNCTION(val));
+        else if(IS_OBJCLASS(val))
+            add_class_functions(s, AS_OBJCLASS(val));
+    }
+    const struct bytecode_chunk* chunk = s->chunk;
+    for(int offset = 0; offset < (int)chunk->_code.size; offset += bcchunk_instruction_size(chunk->_code.data[offset])){
+        op_t op = chunk->_code.data[offset];
+        if(op >= OP_COUNT)
+            return false;
+        switch(op){
+            case OP_CALL: case OP_CHECK_ARGS: case OP_MEMO_RETURN:
+                add_function(s, (obj_function_t*)read_data(chunk, offset, 0).obj);
+                break;
+            case OP_INVOKE:
+                add_class_functions(s, (obj_class_t*)read_data(chunk, offset, 0).obj);
+                add_function(s, (obj_function_t*)read_data(chunk, offset, 1).obj);
+                break;
+            case OP_INSTANCE:
+                add_class_functions(s, (obj_class_t*)read_data(chunk, offset, 0).obj);
+                break;
+            default:
+                break;
+        }
+    }
+    qsort(s->funcs, s->funcs_count, sizeof(obj_function_t*), compare_functions);
+    int count = 0;
+    for(int i = 0; i < s->funcs_count; i++)
+        if(count == 0 || s->funcs[count - 1] != s->funcs[i])
+            s->funcs[count++] = s->funcs[i];
+    s->funcs_count = count;
+    return true;
+}
+
+static void add_function(struct stripper* s, obj_function_t* func){
+    //declared but not defined functions have no code
+    if(func->entry_offset < 0)
+        return;
+    if(s->funcs_count == s->funcs_capacity){
+        s->funcs_capacity = s->funcs_capacity ? s->funcs_capacity * 2 : 64;
+        s->funcs = erealloc(s->funcs, sizeof(obj_function_t*) * s->funcs_capacity);
+    }
+    s->funcs[s->funcs_count++] = func;
+}
+
+static void add_class_functions(struct stripper* s, const obj_class_t* cl){
+    for(int i = 0; i <= CONSTRUCTORS_LIMIT && cl->constructors[i] != NULL; i++)
+        add_function(s, cl->constructors[i]);
+    for(size_t i = 0; i < cl->methods->capacity; i++)
+        if(cl->methods->entries[i].key != NULL && IS_OBJFUNCTION(cl->methods->entries[i].value))
+            add_function(s, AS_OBJFUNCTION(cl->methods->entries[i].value));
+}
+
+//functions with the same entry offset stay next to each other
+static int compare_functions(const void* a, const void* b){
+    const obj_function_t* f1 = *(const obj_function_t* const*)a;
+    const obj_function_t* f2 = *(const obj_function_t* const*)b;
+    if(f1->entry_offset != f2->entry_offset)
+        return f1->entry_offset < f2->entry_offset ? -1 : 1;
+    return f1 < f2 ? -1 : f1 > f2;
+}
+
+//return index of the last function that starts at or before the offset, -1 if there is no such
+static int find_function(const struct stripper* s, int offset){
+    int lo = 0, hi = s->funcs_count - 1, res = -1;
+    while(lo <= hi){
+        int mid = (lo + hi) / 2;
+        if(s->starts[mid] <= offset){
+            res = mid;
+            lo = mid + 1;
+        }else{
+            hi = mid - 1;
+        }
+    }
+    return res;
+}
+
+//code of the function lasts until the next entry
+static inline int function_end(const struct stripper* s, int idx){
+    for(int i = idx + 1; i < s->funcs_count; i++)
+        if(s->starts[i] != s->starts[idx])
+            return s->starts[i];
+    return s->chunk->_code.size;
+}
+
+//all functions with the same entry share the code
+static void mark_function(struct stripper* s, const obj_function_t* func){
+    if(func->entry_offset < 0)
+        return;
+    int idx = find_function(s, func->entry_offset);
+    if(idx < 0 || s->starts[idx] != func->entry_offset)
+        return;
+    for(; idx >= 0 && s->starts[idx] == func->entry_offset; idx--){
+        if(!s->is_live[idx]){
+            s->is_live[idx] = true;
+            s->work[s->work_count++] = idx;
+        }
+    }
+}
+
+static void mark_class(struct stripper* s, const obj_class_t* cl){
+    for(int i = 0; i < s->classes_count; i++)
+        if(s->classes[i] == cl)
+            return;
+    if(s->classes_count == s->classes_capacity){
+        s->classes_capacity = s->classes_capacity ? s->classes_capacity * 2 : 16;
+        s->classes = erealloc(s->classes, sizeof(obj_class_t*) * s->classes_capacity);
+    }
+    s->classes[s->classes_count++] = cl;
+    for(int i = 0; i <= CONSTRUCTORS_LIMIT && cl->constructors[i] != NULL; i++)
+        mark_function(s, cl->constructors[i]);
+    for(size_t i = 0; i < cl->methods->capacity; i++)
+        if(cl->methods->entries[i].key != NULL && IS_OBJFUNCTION(cl->methods->entries[i].value))
+            mark_function(s, AS_OBJFUNCTION(cl->methods->entries[i].value));
+}
+
+static void mark_value(struct stripper* s, value_t val){
+    if(IS_OBJFUNCTION(val))
+        mark_function(s, AS_OBJFUNCTION(val));
+    else if(IS_OBJCLASS(val))
+        mark_class(s, AS_OBJCLASS(val));
+}
+
+//a global variable may hold a function or a class
+static void mark_globals(struct stripper* s){
+    for(size_t i = 0; i < symtable.capacity; i++){
+        const hash_entry* e = &symtable.entries[i];
+        if(e->key == NULL)
+            continue;
+        if(IS_OBJFUNCTION(e->value) && AS_OBJFUNCTION(e->value)->base.name != e->key)
+            mark_function(s, AS_OBJFUNCTION(e->value));
+        else if(IS_OBJCLASS(e->value) && AS_OBJCLASS(e->value)->name != e->key)
+            mark_class(s, AS_OBJCLASS(e->value));
+    }
+}
+
+//the whole code of the function is scanned, including unreachable instructions
+static void scan_function(struct stripper* s, int idx){
+    const struct bytecode_chunk* chunk = s->chunk;
+    int end = function_end(s, idx);
+    for(int offset = s->starts[idx]; offset < end; offset += bcchunk_instruction_size(chunk->_code.data[offset])){
+        value_t val;
+        switch((op_t)chunk->_code.data[offset]){
+            case OP_CALL:
+                mark_function(s, (obj_function_t*)read_data(chunk, offset, 0).obj);
+                break;
+            case OP_INVOKE:
+                mark_class(s, (obj_class_t*)read_data(chunk, offset, 0).obj);
+                mark_function(s, (obj_function_t*)read_data(chunk, offset, 1).obj);
+                break;
+            case OP_INSTANCE:
+                mark_class(s, (obj_class_t*)read_data(chunk, offset, 0).obj);
+                break;
+            case OP_GET_GLOBAL:
+                if(symtable_get((obj_id_t*)read_data(chunk, offset, 0).obj, &val))
+                    mark_value(s, val);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+//moves the code of live functions to the beginning of the chunk, the most called ones are placed first
+//relocates their entries, exception handlers and line runs, return count of removed bytes
+static int compact(struct stripper* s){
+    struct bytecode_chunk* chunk = s->chunk;
+    const struct line_run* runs = (const struct line_run*)chunk->_line_data.data;
+    size_t runs_count = chunk->_line_data.size / sizeof(struct line_run);
+    //functions with the same entry share the code, it is placed once
+    struct placement* order = emalloc(sizeof(struct placement) * (s->funcs_count + 1));
+    int order_count = 0;
+    for(int i = 0; i < s->funcs_count; i++){
+        if(i > 0 && s->starts[i] == s->starts[i - 1]){
+            struct placement* last = order_count > 0 ? &order[order_count - 1] : NULL;
+            if(last != NULL && last->start == s->starts[i] && last->calls < s->funcs[i]->calls)
+                last->calls = s->funcs[i]->calls;
+        }else if(s->is_live[i]){
+            order[order_count++] = (struct placement){.idx = i, .start = s->starts[i], .calls = s->funcs[i]->calls};
+        }
+    }
+    //without a profile all counts are 0 and the source order is kept
+    qsort(order, order_count, sizeof(struct placement), compare_placements);
+
+    //every live function adds at most one run at its start
+    struct line_run* new_runs = emalloc(sizeof(struct line_run) * (runs_count + s->funcs_count + 1));
+    size_t new_runs_count = 0;
+    int* new_starts = emalloc(sizeof(int) * (s->funcs_count + 1));
+    byte_t* code = emalloc(chunk->_code.size + 1);
+    int size = 0;
+    for(int i = 0; i < order_count; i++){
+        int idx = order[i].idx;
+        int end = function_end(s, idx);
+        memcpy(code + size, chunk->_code.data + s->starts[idx], end - s->starts[idx]);
+        new_starts[idx] = size;
+        //runs of the moved code, the first one starts with the function
+        int delta = size - s->starts[idx];
+        add_run(new_runs, &new_runs_count, size, bcchunk_get_line(chunk, s->starts[idx]));
+        for(size_t run = find_run(runs, runs_count, s->starts[idx]); run < runs_count && runs[run].offset < end; run++)
+            add_run(new_runs, &new_runs_count, runs[run].offset + delta, runs[run].line);
+        size += end - s->starts[idx];
+    }
+    free(order);
+    for(int i = 1; i < s->funcs_count; i++)
+        if(s->starts[i] == s->starts[i - 1])
+            new_starts[i] = new_starts[i - 1];
+
+    struct exception_handler* handlers = (struct exception_handler*)chunk->_handlers.data;
+    size_t handlers_count = chunk->_handlers.size / sizeof(struct exception_handler);
+    size_t live_handlers = 0;
+    for(size_t i = 0; i < handlers_count; i++){
+        int idx = find_function(s, handlers[i].start);
+        if(idx < 0 || !s->is_live[idx])
+            continue;
+        int delta = new_starts[idx] - s->starts[idx];
+        struct exception_handler h = handlers[i];
+        h.start += delta;
+        h.end += delta;
+        h.target += delta;
+        handlers[live_handlers++] = h;
+    }
+    chunk->_handlers.size = live_handlers * sizeof(struct exception_handler);
+
+    for(int i = 0; i < s->funcs_count; i++){
+        obj_function_t* func = s->funcs[i];
+        if(s->is_live[i]){
+            func->entry_offset = new_starts[i];
+            continue;
+        }
+        func->entry_offset = -1;
+        value_t val;
+        if(symtable_get(func->base.name, &val) && IS_OBJFUNCTION(val) && AS_OBJFUNCTION(val) == func)
+            table_unset(&symtable, func->base.name);
+    }
+    free(new_starts);
+
+    int removed = chunk->_code.size - size;
+    if(size > 0){
+        free(chunk->_code.data);
+        chunk->_code.data = code;
+        chunk->_code.capacity = chunk->_code.size = size;
+        free(chunk->_line_data.data);
+        chunk->_line_data.data = (byte_t*)new_runs;
+        chunk->_line_data.capacity = chunk->_line_data.size = sizeof(struct line_run) * new_runs_count;
+    }else{
+        free(code);
+        free(new_runs);
+    }
+    return removed;
+}
+
+//hot functions first, others keep the order of the source
+static int compare_placements(const void* a, const void* b){
+    const struct placement* p1 = a;
+    const struct placement* p2 = b;
+    if(p1->calls != p2->calls)
+        return p1->calls > p2->calls ? -1 : 1;
+    return p1->start < p2->start ? -1 : p1->start > p2->start;
+}
+
+static size_t find_run(const struct line_run* runs, size_t count, int offset){
+    size_t lo = 0, hi = count;
+    while(lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        if(runs[mid].offset <= offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static inline void add_run(struct line_run* runs, size_t* count, int offset, int line){
+    if(*count == 0 || runs[*count - 1].line != line)
+        runs[(*count)++] = (struct line_run){.offset = offset, .line = line};
+}
+
+static void remove_dead_classes(const struct stripper* s){
+    for(size_t i = 0; i < symtable.capacity; i++){
+        hash_entry* e = &symtable.entries[i];
+        if(e->key == NULL || !IS_OBJCLASS(e->value))
+            continue;
+        bool is_live = false;
+        for(int j = 0; j < s->classes_count && !is_live; j++)
+            is_live = s->classes[j] == AS_OBJCLASS(e->value);
+        if(!is_live)
+            table_unset(&symtable, e->key);
+    }
+}
+
+static inline int read_operand(const struct bytecode_chunk* chunk, int offset, int idx){
+    return *(int*)(chunk->_code.data + offset + 1 + idx * sizeof(int));
+}
+
+static inline union _inner_value_t read_data(const struct bytecode_chunk* chunk, int offset, int idx){
+    return *(union _inner_value_t*)(chunk->_data.data + read_operand(chunk, offset, idx));
+}
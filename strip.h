@@ -0,0 +1,25 @@
+#ifndef STRIP_H
+#define STRIP_H
+
+#include "bytecode.h"
+#include "lang_types.h"
+
+/*
+Dead code elimination runs once after compilation.
+Functions and classes are reachable from the entry function through:
+ - OP_CALL, OP_INVOKE and OP_CHECK_ARGS of reachable code
+ - OP_INSTANCE and OP_INVOKE, all constructors and methods of the class are reachable,
+   because OP_METHOD finds them by name at run time
+ - globals that hold a function or a class under another name
+Code of every function lasts until the entry of the next one, unreachable functions are removed
+and the chunk is compacted: entry offsets and exception handlers are relocated,
+jumps are relative and stay in their function, so they are not changed.
+Functions are placed by their counts of calls from the profile, the most called first,
+functions with the same count keep the order of the source.
+Unreachable functions and classes are removed from the symtable.
+*/
+
+//return count of removed bytes of code
+int bcchunk_strip(struct bytecode_chunk* chunk, obj_function_t* entry);
+
+#endif
@@ -4,10 +4,32 @@
 #include "lang_types.h"
 #include "token.h"
 #include "native_functions.h"
+#include "bytecode.h"
 #include <string.h>
 #include <stdio.h>
 
-static void natfunc_set(const char* name, native_function func);
+static void natfunc_set(const struct native_info* info);
+
+//intrinsics are compiled to the opcode instead of a call
+static const struct native_info natives[] = {
+    {"clock", native_clock, 0, 0, -1},
+    {"print", native_print, NATIVE_VARIADIC, 0, -1},
+    {"println", native_println, NATIVE_VARIADIC, 0, -1},
+    {"isnum", native_isnum, 1, NATIVE_PURE, OP_IS_NUM},
+    {"isstr", native_isstr, 1, NATIVE_PURE, OP_IS_STR},
+    {"isbool", native_isbool, 1, NATIVE_PURE, OP_IS_BOOL},
+    {"isinst", native_isinst, 1, NATIVE_PURE, OP_IS_INST},
+    {"isnone", native_isnone, 1, NATIVE_PURE, OP_IS_NONE},
+    {"isuninit", native_isuninit, 1, NATIVE_PURE, OP_IS_UNINIT},
+    {"sqrt", native_sqrt, 1, NATIVE_PURE, OP_SQRT},
+    {"floor", native_floor, 1, NATIVE_PURE, OP_FLOOR},
+    {"abs", native_abs, 1, NATIVE_PURE, OP_ABS},
+    {"min", native_min, 2, NATIVE_PURE, OP_MIN},
+    {"max", native_max, 2, NATIVE_PURE, OP_MAX},
+    {"pow", native_pow, 2, NATIVE_PURE, OP_POW},
+    {"exit", native_exit, 1, 0, -1},
+    {"getchar", native_getchar, 0, NATIVE_ALLOCATES, -1}
+};
 
 static struct trie_node* keywords = NULL;
 struct hash_table symtable;
@@ -35,21 +57,20 @@ void symtable_init(){
     tr_add(keywords, "field", T_FIELD);
     tr_add(keywords, "meth", T_METH);
     tr_add(keywords, "override", T_OVERRIDE);
+    tr_add(keywords, "switch", T_SWITCH);
+    tr_add(keywords, "case", T_CASE);
+    tr_add(keywords, "default", T_DEFAULT);
+    tr_add(keywords, "try", T_TRY);
+    tr_add(keywords, "catch", T_CATCH);
+    tr_add(keywords, "throw", T_THROW);
+    tr_add(keywords, "memo", T_MEMO);
+    tr_add(keywords, "import", T_IMPORT);
 
     table_init(&symtable);
     table_init(&stringtable);
 
-    natfunc_set("clock", native_clock);
-    natfunc_set("print", native_print);
-    natfunc_set("println", native_println);
-    natfunc_set("isnum", native_isnum);
-    natfunc_set("isstr", native_isstr);
-    natfunc_set("isbool", native_isbool);
-    natfunc_set("isinst", native_isinst);
-    natfunc_set("isnone", native_isnone);
-    natfunc_set("isuninit", native_isuninit);
-    natfunc_set("exit", native_exit);
-    natfunc_set("getchar", native_getchar); 
+    for(size_t i = 0; i < sizeof(natives) / sizeof(natives[0]); i++)
+        natfunc_set(&natives[i]);
 }
 
 void symtable_cleanup(){
@@ -95,10 +116,12 @@ bool symtable_get(const obj_id_t* id, value_t* value){
     return table_check(&symtable, id, value);
 }
 
-static void natfunc_set(const char* name, native_function func){
-    size_t len = strlen(name);
-    obj_id_t* id = mk_objid(name, len, hash_string(name, len));
-    symtable_set(id, VALUE_OBJ(mk_objnatfunc(id, func)));
+static void natfunc_set(const struct native_info* info){
+    size_t len = strlen(info->name);
+    obj_id_t* id = mk_objid(info->name, len, hash_string(info->name, len));
+    obj_natfunction_t* p = mk_objnatfunc(id, info->impl, info->argc, info->flags);
+    p->intrinsic = info->intrinsic;
+    symtable_set(id, VALUE_OBJ(p));
 }
 
 #ifdef DEBUG
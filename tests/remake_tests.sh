@@ -27,7 +27,7 @@ do
 
     DIR=${DIR%/}
     echo ===$DIR===
-    for FILE in $(find  ${DIR} -name ${TESTNAME}'[0-9]*' | sort)
+    for FILE in $(find  ${DIR} -name ${TESTNAME}'[0-9]*' ! -name '*.enmac' | sort)
     do
         NUMBER=${FILE#${DIR}/${TESTNAME}}
         "${EXECUTABLE}" "${FILE}" &> "${DIR}/${TESTNAME}_out${NUMBER}"
@@ -11,11 +11,26 @@ RED='\033[0;31m'
 NC='\033[0m'
 GREEN='\033[0;32m'
 
+# writes an unknown instruction over the first one of the code section, that starts at the first page
+# the checksum at the end of the file is computed again (FNV-1a), so the cache is still loaded
+damage_cache(){
+    local CACHE=$1
+    local SIZE=$(($(stat -c %s "${CACHE}") - 8))
+    printf '\xff' | dd of="${CACHE}" bs=1 seek=4096 conv=notrunc status=none
+    local HASH=-3750763034362895579
+    for BYTE in $(od -An -v -tu1 -N${SIZE} "${CACHE}"); do
+        HASH=$(( (HASH ^ BYTE) * 1099511628211 ))
+    done
+    for i in 0 1 2 3 4 5 6 7; do
+        printf "\\x$(printf %02x $(( (HASH >> (8 * i)) & 255 )))"
+    done | dd of="${CACHE}" bs=1 seek=${SIZE} conv=notrunc status=none
+}
+
 for DIR in $(ls -d */)
 do
     DIR=${DIR%/}
     echo ===$DIR===
-    for FILE in $(find  ${DIR} -name ${TESTNAME}'[0-9]*' | sort)
+    for FILE in $(find  ${DIR} -name ${TESTNAME}'[0-9]*' ! -name '*.enmac' | sort)
     do
         NUMBER=${FILE#${DIR}/${TESTNAME}}
         "${EXECUTABLE}" "${FILE}" &> "${DIR}/${TESTNAME}_temp${NUMBER}"
@@ -25,7 +40,48 @@ do
         else
             printf "${RED}${DIR}/${TESTNAME}${NUMBER} - failed\n${NC}" 
         fi
+        # the first run saves the bytecode cache, the second one loads it
+        "${EXECUTABLE}" --cache "${FILE}" &> /dev/null
+        "${EXECUTABLE}" --cache "${FILE}" &> "${DIR}/${TESTNAME}_temp${NUMBER}"
+        rm -f "${FILE}.enmac"
+        printf ${RED}
+        if diff "${DIR}/${TESTNAME}_temp${NUMBER}" "${DIR}/${TESTNAME}_out${NUMBER}"; then
+            printf "${GREEN}${DIR}/${TESTNAME}${NUMBER} (cached) - good\n${NC}"
+        else
+            printf "${RED}${DIR}/${TESTNAME}${NUMBER} (cached) - failed\n${NC}" 
+        fi
+        # the second run places functions and caches classes at sites by the profile of the first one
+        "${EXECUTABLE}" --profile "${FILE}" &> /dev/null
+        "${EXECUTABLE}" "${FILE}" &> "${DIR}/${TESTNAME}_temp${NUMBER}"
+        rm -f "${FILE}.enmap"
+        printf ${RED}
+        if diff "${DIR}/${TESTNAME}_temp${NUMBER}" "${DIR}/${TESTNAME}_out${NUMBER}"; then
+            printf "${GREEN}${DIR}/${TESTNAME}${NUMBER} (profiled) - good\n${NC}"
+        else
+            printf "${RED}${DIR}/${TESTNAME}${NUMBER} (profiled) - failed\n${NC}" 
+        fi
+        "${EXECUTABLE}" --lazy "${FILE}" &> "${DIR}/${TESTNAME}_temp${NUMBER}"
+        printf ${RED}
+        if diff "${DIR}/${TESTNAME}_temp${NUMBER}" "${DIR}/${TESTNAME}_out${NUMBER}"; then
+            printf "${GREEN}${DIR}/${TESTNAME}${NUMBER} (lazy) - good\n${NC}"
+        else
+            printf "${RED}${DIR}/${TESTNAME}${NUMBER} (lazy) - failed\n${NC}" 
+        fi
     done
 
     rm ${DIR}/${TESTNAME}_temp*
-done
\ No newline at end of file
+done
+
+# the damaged cache fails the verifier, so the checked loop runs it and stops at the unknown instruction
+FILE=other/${TESTNAME}12
+"${EXECUTABLE}" --cache "${FILE}" &> /dev/null
+damage_cache "${FILE}.enmac"
+"${EXECUTABLE}" --cache "${FILE}" &> other/${TESTNAME}_temp12
+rm -f "${FILE}.enmac"
+printf ${RED}
+if diff other/${TESTNAME}_temp12 other/${TESTNAME}_damaged_out12; then
+    printf "${GREEN}${FILE} (damaged cache) - good\n${NC}"
+else
+    printf "${RED}${FILE} (damaged cache) - failed\n${NC}"
+fi
+rm other/${TESTNAME}_temp12
\ No newline at end of file
@@ -21,6 +21,11 @@ typedef enum{
 
     T_ASSIGN = 14,
     T_DOT = 15,
+    //compound assignment
+    T_ADD_ASSIGN,
+    T_SUB_ASSIGN,
+    T_MUL_ASSIGN,
+    T_DIV_ASSIGN,
     T_INCR,
     T_DECR,
     //precedence operators
@@ -32,6 +37,8 @@ typedef enum{
     T_TRUE,
     T_IDENT,
     T_STRING,
+    T_INTERP, //part of a string before '${'
+    T_INTERP_END, //part of a string after the last interpolated expression
     //keywords
     T_VAR,
     T_IF,
@@ -47,6 +54,14 @@ typedef enum{
     T_METH,
     T_THIS,
     T_OVERRIDE,
+    T_SWITCH,
+    T_CASE,
+    T_DEFAULT,
+    T_TRY,
+    T_CATCH,
+    T_THROW,
+    T_MEMO,
+    T_IMPORT,
     //other
     T_SEMI,
     T_COMMA,
@@ -56,7 +71,7 @@ typedef enum{
     T_EOF,
 } token_type; 
 
-#define TOKEN_IS_BIN_OP(op) (T_ADD <= (op) && (op) <= T_DOT)
+#define TOKEN_IS_BIN_OP(op) (T_ADD <= (op) && (op) <= T_DIV_ASSIGN)
 
 struct token{
     token_type type;
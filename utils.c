@@ -5,9 +5,18 @@
 #include <stdarg.h>
 #include <stdlib.h>
 
+jmp_buf* error_trap = NULL;
+char error_message[ERROR_MESSAGE_SIZE];
+int error_line = 0;
+
 __attribute__((noreturn)) void fatal_printf(const char* fmt, ...){
     va_list ap;
     va_start(ap, fmt);
+    if(error_trap != NULL){
+        vsnprintf(error_message, sizeof(error_message), fmt, ap);
+        va_end(ap);
+        longjmp(*error_trap, ERROR_FATAL);
+    }
 
     eprintf("FATAL: ");
     vfprintf(stderr, fmt, ap);
@@ -19,7 +28,10 @@ __attribute__((noreturn)) void compile_error_printf(const char* fmt, ...){
     va_list ap;
     va_start(ap, fmt);
 
-    eprintf("Syntax error at line %d: ", line_counter);
+    if(scanner_import_name() != NULL)
+        eprintf("Syntax error in '%s' at line %d: ", scanner_import_name(), line_counter);
+    else
+        eprintf("Syntax error at line %d: ", line_counter);
     vfprintf(stderr, fmt, ap);
 
     va_end(ap);
@@ -29,6 +41,12 @@ __attribute__((noreturn)) void compile_error_printf(const char* fmt, ...){
 __attribute__((noreturn)) void interpret_error_printf(int line, const char* fmt, ...){
     va_list ap;
     va_start(ap, fmt);
+    if(error_trap != NULL){
+        vsnprintf(error_message, sizeof(error_message), fmt, ap);
+        va_end(ap);
+        error_line = line;
+        longjmp(*error_trap, ERROR_RUNTIME);
+    }
 
     eprintf("Error at line %d: ", line);
     vfprintf(stderr, fmt, ap);
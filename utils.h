@@ -1,6 +1,7 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "scanner.h"
@@ -8,6 +9,15 @@
 
 extern struct token cur_token;
 extern int line_counter;
+//if it is set, runtime errors jump here instead of exiting
+//the value passed to longjmp() is ERROR_RUNTIME or ERROR_FATAL
+extern jmp_buf* error_trap;
+#define ERROR_RUNTIME (1)
+#define ERROR_FATAL (2)
+#define ERROR_MESSAGE_SIZE (256)
+//message and line of the last error that jumped to error_trap
+extern char error_message[ERROR_MESSAGE_SIZE];
+extern int error_line;
 
 #define ARR_SIZE(arr) (sizeof(arr) / sizeof(arr[0]))
 
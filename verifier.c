@@ -0,0 +1,364 @@
+#include "verifier.h"
+#include "hash_table.h"
+#include "utils.h"
+#include <string.h>
+
+#define UNREACHED (-1)
+
+struct verify_task{
+    int offset;
+    int depth; //stack depth relative to bp before the instruction
+    const obj_function_t* func;
+};
+
+struct verifier{
+    const struct bytecode_chunk* chunk;
+    int size;
+    bool* is_start;  //offset begins an instruction
+    int* depth;      //depth before the instruction, UNREACHED if it is not reached yet
+    struct verify_task* tasks;
+    int tasks_count;
+    int tasks_capacity;
+    const obj_function_t** funcs; //functions that are already added
+    int funcs_count;
+    int funcs_capacity;
+    int max_depth;
+};
+
+#define VERIFY_FAIL(offset, ...) do{\
+        dprintf("Verifier: instruction %04X: ", (unsigned)(offset));\
+        dprintf(__VA_ARGS__);\
+        return false;\
+    }while(0)
+
+static bool sweep(struct verifier* v);
+static bool verify_task(struct verifier* v, struct verify_task task);
+static bool add_task(struct verifier* v, int offset, int depth, const obj_function_t* func, int from);
+static bool add_function(struct verifier* v, const obj_function_t* func);
+static bool add_class(struct verifier* v, const obj_class_t* cl);
+static inline bool is_data_index(const struct verifier* v, int index, int count);
+static inline int read_operand(const struct verifier* v, int offset, int idx);
+static inline union _inner_value_t read_data(const struct verifier* v, int offset, int idx);
+
+int bcchunk_verify(const struct bytecode_chunk* chunk, const obj_function_t* entry){
+    struct verifier v = {.chunk = chunk, .size = chunk->_code.size, .max_depth = 0};
+    v.is_start = emalloc(sizeof(bool) * (v.size + 1));
+    v.depth = emalloc(sizeof(int) * (v.size + 1));
+    v.tasks = NULL;
+    v.tasks_count = v.tasks_capacity = 0;
+    v.funcs = NULL;
+    v.funcs_count = v.funcs_capacity = 0;
+
+    bool is_ok = sweep(&v) && add_function(&v, entry);
+    while(is_ok && v.tasks_count > 0)
+        is_ok = verify_task(&v, v.tasks[--v.tasks_count]);
+
+    free(v.is_start);
+    free(v.depth);
+    free(v.tasks);
+    free(v.funcs);
+    return is_ok ? v.max_depth : -1;
+}
+
+//finds instruction boundaries and checks that every instruction is known and complete
+static bool sweep(struct verifier* v){
+    memset(v->is_start, 0, sizeof(bool) * (v->size + 1));
+    for(int i = 0; i <= v->size; i++)
+        v->depth[i] = UNREACHED;
+    int offset = 0;
+    while(offset < v->size){
+        op_t op = v->chunk->_code.data[offset];
+        if(op >= OP_COUNT)
+            VERIFY_FAIL(offset, "unknown instruction %d\n", op);
+        v->is_start[offset] = true;
+        offset += bcchunk_instruction_size(op);
+    }
+    if(offset != v->size)
+        VERIFY_FAIL(offset, "the last instruction is incomplete\n");
+
+    const struct exception_handler* handlers = (const struct exception_handler*)v->chunk->_handlers.data;
+    for(size_t i = 0; i < v->chunk->_handlers.size / sizeof(struct exception_handler); i++){
+        const struct exception_handler* h = &handlers[i];
+        if(h->start < 0 || h->start > h->end || h->end > v->size || !v->is_start[h->start] ||
+           h->target < 0 || h->target >= v->size || !v->is_start[h->target] || h->depth < 0)
+            VERIFY_FAIL(h->start, "invalid exception handler\n");
+    }
+    return true;
+}
+
+static bool add_function(struct verifier* v, const obj_function_t* func){
+    for(int i = 0; i < v->funcs_count; i++)
+        if(v->funcs[i] == func)
+            return true;
+    if(v->funcs_count == v->funcs_capacity){
+        v->funcs_capacity = v->funcs_capacity ? v->funcs_capacity * 2 : 16;
+        v->funcs = erealloc(v->funcs, sizeof(obj_function_t*) * v->funcs_capacity);
+    }
+    v->funcs[v->funcs_count++] = func;
+    //declared but not defined function is reported by the VM when it is called
+    if(func->entry_offset < 0)
+        return true;
+    return add_task(v, func->entry_offset, 0, func, func->entry_offset);
+}
+
+//methods of an instance may be called by name
+static bool add_class(struct verifier* v, const obj_class_t* cl){
+    for(int i = 0; i <= CONSTRUCTORS_LIMIT && cl->constructors[i] != NULL; i++)
+        if(!add_function(v, cl->constructors[i]))
+            return false;
+    for(size_t i = 0; i < cl->methods->capacity; i++)
+        if(cl->methods->entries[i].key != NULL && IS_OBJFUNCTION(cl->methods->entries[i].value))
+            if(!add_function(v, AS_OBJFUNCTION(cl->methods->entries[i].value)))
+                return false;
+    return true;
+}
+
+//the block starting at offset must have the same depth from every predecessor
+static bool add_task(struct verifier* v, int offset, int depth, const obj_function_t* func, int from){
+    (void)from; //the jump is only printed in the debug build
+    if(offset < 0 || offset >= v->size || !v->is_start[offset])
+        VERIFY_FAIL(from, "jump target %04X is not an instruction\n", (unsigned)offset);
+    if(v->depth[offset] != UNREACHED){
+        if(v->depth[offset] != depth)
+            VERIFY_FAIL(from, "stack depth %d at %04X, expected %d\n", depth, (unsigned)offset, v->depth[offset]);
+        return true;
+    }
+    v->depth[offset] = depth;
+    if(v->tasks_count == v->tasks_capacity){
+        v->tasks_capacity = v->tasks_capacity ? v->tasks_capacity * 2 : 64;
+        v->tasks = erealloc(v->tasks, sizeof(struct verify_task) * v->tasks_capacity);
+    }
+    v->tasks[v->tasks_count++] = (struct verify_task){offset, depth, func};
+    return true;
+}
+
+static inline bool is_data_index(const struct verifier* v, int index, int count){
+    return index >= 0 && count >= 0 && (size_t)index + (size_t)count * sizeof(union _inner_value_t) <= v->chunk->_data.size;
+}
+
+static inline int read_operand(const struct verifier* v, int offset, int idx){
+    return *(int*)(v->chunk->_code.data + offset + 1 + idx * sizeof(int));
+}
+
+static inline union _inner_value_t read_data(const struct verifier* v, int offset, int idx){
+    return *(union _inner_value_t*)(v->chunk->_data.data + read_operand(v, offset, idx));
+}
+
+//walks the basic block from the task until a jump or a return
+static bool verify_task(struct verifier* v, struct verify_task task){
+    int offset = task.offset;
+    int depth = task.depth;
+    const int argc = task.func->base.argc;
+    const struct exception_handler* handlers = (const struct exception_handler*)v->chunk->_handlers.data;
+    const size_t handlers_count = v->chunk->_handlers.size / sizeof(struct exception_handler);
+
+    for(;;){
+        if(offset >= v->size)
+            VERIFY_FAIL(offset, "execution runs out of the code\n");
+        if(v->depth[offset] != UNREACHED && offset != task.offset){
+            if(v->depth[offset] != depth)
+                VERIFY_FAIL(offset, "stack depth %d, expected %d\n", depth, v->depth[offset]);
+            return true;
+        }
+        v->depth[offset] = depth;
+        for(size_t i = 0; i < handlers_count; i++)
+            if(handlers[i].start <= offset && offset < handlers[i].end){
+                if(handlers[i].depth > depth)
+                    VERIFY_FAIL(offset, "try block has more locals than the frame\n");
+                if(!add_task(v, handlers[i].target, handlers[i].depth + 1, task.func, offset))
+                    return false;
+            }
+
+        op_t op = v->chunk->_code.data[offset];
+        int next = offset + bcchunk_instruction_size(op);
+        int pops = 0, pushes = 0;
+        bool is_end = false;
+        //operands that are indices in _data section
+        int data_operands = 0;
+
+        switch(op){
+            case OP_RETURN: case OP_MEMO_RETURN: case OP_THROW:
+                pops = 1;
+                is_end = true;
+                data_operands = op == OP_MEMO_RETURN;
+                break;
+            case OP_POP: pops = 1; break;
+            case OP_POPN: pops = read_operand(v, offset, 0); break;
+            case OP_CLARGS: pops = read_operand(v, offset, 0) + 1; pushes = 1; break;
+            case OP_POPN_SHORT: pops = v->chunk->_code.data[offset + 1]; break;
+            case OP_CLARGS_SHORT: pops = v->chunk->_code.data[offset + 1] + 1; pushes = 1; break;
+            case OP_GET_LOCAL_0: case OP_GET_LOCAL_1: case OP_GET_LOCAL_2: case OP_GET_LOCAL_3:
+            case OP_GET_LOCAL_SHORT:
+                pushes = 1;
+                break;
+            case OP_SET_LOCAL_SHORT:
+                pops = pushes = 1;
+                break;
+            case OP_NONE: pushes = 1; break;
+            case OP_NUMBER: case OP_BOOLEAN: case OP_STRING: case OP_GET_GLOBAL: case OP_INSTANCE:
+            case OP_POSTINCR_GLOBAL: case OP_POSTDECR_GLOBAL: case OP_PREFINCR_GLOBAL: case OP_PREFDECR_GLOBAL:
+                pushes = 1;
+                data_operands = 1;
+                break;
+            case OP_GET_LOCAL:
+            case OP_POSTINCR_LOCAL: case OP_POSTDECR_LOCAL: case OP_PREFINCR_LOCAL: case OP_PREFDECR_LOCAL:
+                pushes = 1;
+                data_operands = 1;
+                break;
+            case OP_SET_GLOBAL: case OP_SET_LOCAL: case OP_GET_FIELD:
+            case OP_ADD_ASSIGN_LOCAL: case OP_SUB_ASSIGN_LOCAL: case OP_MUL_ASSIGN_LOCAL: case OP_DIV_ASSIGN_LOCAL:
+            case OP_ADD_ASSIGN_GLOBAL: case OP_SUB_ASSIGN_GLOBAL: case OP_MUL_ASSIGN_GLOBAL: case OP_DIV_ASSIGN_GLOBAL:
+                pops = pushes = 1;
+                data_operands = 1;
+                break;
+            case OP_SET_FIELD:
+            case OP_ADD_ASSIGN_FIELD: case OP_SUB_ASSIGN_FIELD: case OP_MUL_ASSIGN_FIELD: case OP_DIV_ASSIGN_FIELD:
+                pops = 2;
+                pushes = 1;
+                data_operands = 1;
+                break;
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+            case OP_AND: case OP_OR: case OP_XOR:
+            case OP_EQUAL: case OP_GREATER: case OP_LESS:
+            case OP_ADD_NUM: case OP_SUB_NUM: case OP_MUL_NUM: case OP_DIV_NUM:
+            case OP_EQUAL_NUM: case OP_GREATER_NUM: case OP_LESS_NUM:
+            case OP_MIN: case OP_MAX: case OP_POW:
+                pops = 2;
+                pushes = 1;
+                break;
+            case OP_NOT: case OP_CHECK_TYPE:
+            case OP_IS_NUM: case OP_IS_STR: case OP_IS_BOOL: case OP_IS_INST: case OP_IS_NONE: case OP_IS_UNINIT:
+            case OP_SQRT: case OP_FLOOR: case OP_ABS:
+                pops = pushes = 1;
+                break;
+            case OP_JUMP:
+                is_end = true;
+                if(!add_task(v, next + read_operand(v, offset, 0), depth, task.func, offset))
+                    return false;
+                break;
+            case OP_FJUMP: case OP_TJUMP:
+                pops = 1;
+                if(depth < 1)
+                    VERIFY_FAIL(offset, "stack underflow\n");
+                if(!add_task(v, next + read_operand(v, offset, 0), depth - 1, task.func, offset))
+                    return false;
+                break;
+            case OP_FORLOOP_LESS: case OP_FORLOOP_ELESS: case OP_FORLOOP_GREATER: case OP_FORLOOP_EGREATER:
+                //the limit may be an argument of the function
+                for(int i = 0; i < 2; i++){
+                    int idx = read_operand(v, offset, i);
+                    if(!((idx >= 0 && idx < depth) || (idx <= -3 && idx >= -3 - argc)))
+                        VERIFY_FAIL(offset, "loop local is out of the frame\n");
+                }
+                if(!add_task(v, next + read_operand(v, offset, 2), depth, task.func, offset))
+                    return false;
+                break;
+            case OP_SWITCH_TABLE: case OP_SWITCH_HASH:{
+                is_end = true;
+                if(depth < 1)
+                    VERIFY_FAIL(offset, "stack underflow\n");
+                int table = read_operand(v, offset, 0);
+                if(!is_data_index(v, table, 3))
+                    VERIFY_FAIL(offset, "switch table is out of _data section\n");
+                const union _inner_value_t* t = (const union _inner_value_t*)(v->chunk->_data.data + table);
+                int count = t[op == OP_SWITCH_TABLE ? 1 : 0].number;
+                int first = op == OP_SWITCH_TABLE ? 3 : 4;
+                int step = op == OP_SWITCH_TABLE ? 1 : 2;
+                if(!is_data_index(v, table, 3 + step * count))
+                    VERIFY_FAIL(offset, "switch table is out of _data section\n");
+                if(!add_task(v, next + (int)t[op == OP_SWITCH_TABLE ? 2 : 1].number, depth - 1, task.func, offset))
+                    return false;
+                for(int i = 0; i < count; i++){
+                    int jump = t[first + step * i].number;
+                    //empty slots of the hash table
+                    if(op == OP_SWITCH_HASH && jump < 0)
+                        continue;
+                    if(!add_task(v, next + jump, depth - 1, task.func, offset))
+                        return false;
+                }
+                break;
+            }
+            case OP_GET_PATH:{
+                int table = read_operand(v, offset, 0);
+                if(!is_data_index(v, table, 1) || !is_data_index(v, table, 1 + 3 * (int)read_data(v, offset, 0).number))
+                    VERIFY_FAIL(offset, "path table is out of _data section\n");
+                pops = pushes = 1;
+                break;
+            }
+            case OP_CONCAT_N:
+                pops = read_operand(v, offset, 0);
+                pushes = 1;
+                if(pops < 1)
+                    VERIFY_FAIL(offset, "invalid count of values\n");
+                break;
+            case OP_CALL: case OP_INVOKE:{
+                int idx = op == OP_INVOKE;
+                data_operands = 1 + idx;
+                if(!is_data_index(v, read_operand(v, offset, 0), 1) || !is_data_index(v, read_operand(v, offset, idx), 1))
+                    VERIFY_FAIL(offset, "index is out of _data section\n");
+                const obj_function_t* callee = (const obj_function_t*)read_data(v, offset, idx).obj;
+                if(op == OP_INVOKE && !add_class(v, (const obj_class_t*)read_data(v, offset, 0).obj))
+                    return false;
+                if(!add_function(v, callee))
+                    return false;
+                //arguments(and the instance) stay on the stack, the result is pushed
+                pops = callee->base.argc + idx;
+                pushes = pops + 1;
+                break;
+            }
+            case OP_NATIVE_CALL:
+                data_operands = 1;
+                pops = read_operand(v, offset, 1);
+                pushes = 1;
+                break;
+            case OP_METHOD:
+                //the argument count is on the top, the callee is checked when its class is added
+                data_operands = 1;
+                pops = pushes = 1;
+                break;
+            case OP_CHECK_ARGS:
+                data_operands = 1;
+                break;
+            default:
+                VERIFY_FAIL(offset, "instruction %s is not supported by the verifier\n", op_to_string(op));
+        }
+
+        for(int i = 0; i < data_operands; i++)
+            if(!is_data_index(v, read_operand(v, offset, i), 1))
+                VERIFY_FAIL(offset, "index is out of _data section\n");
+        switch(op){
+            //arguments and the instance of a method are below the return address and the old bp
+            case OP_GET_LOCAL: case OP_SET_LOCAL:
+            case OP_POSTINCR_LOCAL: case OP_POSTDECR_LOCAL: case OP_PREFINCR_LOCAL: case OP_PREFDECR_LOCAL:
+            case OP_ADD_ASSIGN_LOCAL: case OP_SUB_ASSIGN_LOCAL: case OP_MUL_ASSIGN_LOCAL: case OP_DIV_ASSIGN_LOCAL:{
+                double idx = read_data(v, offset, 0).number;
+                if(idx != (int)idx || !((idx >= 0 && idx < depth - pops) || (idx <= -3 && idx >= -3 - argc)))
+                    VERIFY_FAIL(offset, "local %g is out of the frame\n", idx);
+                break;
+            }
+            case OP_GET_LOCAL_0: case OP_GET_LOCAL_1: case OP_GET_LOCAL_2: case OP_GET_LOCAL_3:
+            case OP_GET_LOCAL_SHORT: case OP_SET_LOCAL_SHORT:{
+                int idx = op == OP_GET_LOCAL_SHORT || op == OP_SET_LOCAL_SHORT ?
+                    (int8_t)v->chunk->_code.data[offset + 1] : (int)(op - OP_GET_LOCAL_0);
+                if(!((idx >= 0 && idx < depth - pops) || (idx <= -3 && idx >= -3 - argc)))
+                    VERIFY_FAIL(offset, "local %d is out of the frame\n", idx);
+                break;
+            }
+            case OP_INSTANCE:
+                if(!add_class(v, (const obj_class_t*)read_data(v, offset, 0).obj))
+                    return false;
+                break;
+            default:
+                break;
+        }
+
+        if(pops < 0 || depth < pops)
+            VERIFY_FAIL(offset, "stack underflow\n");
+        depth += pushes - pops;
+        if(depth > v->max_depth)
+            v->max_depth = depth;
+        if(is_end)
+            return true;
+        offset = next;
+    }
+}
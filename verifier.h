@@ -0,0 +1,20 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include "bytecode.h"
+#include "lang_types.h"
+
+/*
+Verifier runs once after compilation and proves that the code reachable from the entry function
+cannot break the VM, so it may run without the runtime guards:
+ - every instruction is known and its operands are in the code
+ - jump targets (jumps, loops, switch tables and catch blocks) are instruction boundaries
+ - indices in _data section are in range, locals are in the frame
+ - every frame has the same stack depth at every entry of a basic block and never pops below its bp
+*/
+
+//return the maximal depth of a frame or -1 if the chunk is not verified
+//the reason is printed in DEBUG
+int bcchunk_verify(const struct bytecode_chunk* chunk, const obj_function_t* entry);
+
+#endif
@@ -7,8 +7,15 @@
 #include "utils.h"
 #include "parser.h"
 #include "garbage_collector.h"
+#include "memo.h"
+#include "verifier.h"
+#include "strip.h"
+#include "bccache.h"
+#include "profile.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 
 struct virtual_machine vm;
 int is_done = 0;
@@ -17,11 +24,33 @@ int return_code = 0;
 #define VM_STACK_START (vm.stack)
 #define VM_STACK_END (VM_STACK_START + sizeof(vm.stack) / sizeof(vm.stack[0]))
 #define ENTRY_FUNCTION_NAME "main"
+//backward jumps and calls allowed in the compile time evaluation
+#define EVAL_STEPS_LIMIT (100000)
+
+//copies of arguments of the memo calls that missed the cache,
+//the body may assign to its arguments, so the key is taken at the call
+struct memo_call{
+    const value_t* args; //arguments of the frame in the stack
+    int key; //index of the copy in memo_keys
+    int argc;
+};
+//every frame holds its arguments, so the pending calls fit in the size of the stack
+static struct memo_call memo_calls[STACK_SIZE];
+static value_t memo_keys[STACK_SIZE];
+static int memo_calls_count = 0;
 
 static void vm_init();
 static void vm_free();
-static vm_execute_result vm_execute(struct bytecode_chunk* code);
+static vm_execute_result vm_execute(struct bytecode_chunk* code, bool is_lazy);
+//compiles the body skipped by the lazy parser, ip is moved to the reallocated code
+//return false if the function is already compiled
+static bool compile_lazy(obj_function_t* p);
+static obj_function_t* find_entry();
 static vm_execute_result interpret();
+//the loop is instantiated twice: with runtime guards and for the code proven by the verifier
+static inline __attribute__((always_inline)) vm_execute_result interpret_loop(const bool checked);
+static vm_execute_result interpret_checked();
+static vm_execute_result interpret_unchecked();
 
 #ifdef DEBUG
 static void examine_stack(); 
@@ -36,43 +65,114 @@ static inline byte_t read_byte();
 static inline int read_constant();
 //extract value from data chunk
 static inline union _inner_value_t extract_value(int offset);
+//return pointer to consecutive values in data chunk
+static inline union _inner_value_t* extract_table(int offset);
+//line of the call of the current frame, the check of arguments is done in the callee
+static int get_caller_codeline();
 static value_t get_variable_value(obj_id_t* id);
 static void set_variable_value(obj_id_t* id, value_t value);
 
 static void extract_instance(value_t* val, int argc);
+//return pointer to the field of the instance
+static value_t* extract_field(value_t inst, obj_id_t* field);
+//perform OP_ADD, OP_SUB, OP_MUL or OP_DIV
+static value_t perform_arith(op_t op, value_t a, value_t b);
+static inline void count_step(){
+    if(vm.steps_left >= 0 && --vm.steps_left < 0)
+        interpret_error_printf(get_vm_codeline(), "Evaluation steps limit is exceeded\n");
+}
+
+static obj_function_t* find_method(value_t inst, obj_id_t* meth, int argc);
 static void perform_call(obj_function_t* p);
+static inline void count_step();
+static void eval_call(obj_function_t* p, int argc, const value_t* argv, value_t* result);
+static void eval_native(obj_natfunction_t* p, int argc, const value_t* argv, value_t* result);
 
 static void preamble();
 static void epilogue();
+//saves the arguments of the call of the memo function whose result is not cached
+static void memo_begin(const obj_function_t* p);
+//stores the result of the current frame under the arguments saved by memo_begin()
+static void memo_end(obj_function_t* p, value_t result);
+//forgets the calls whose arguments are at the limit or above it, their frames are unwound
+static void memo_drop(const value_t* limit);
+
+//unwinds frames to the handler of the exception and jumps to its catch block
+//reports the exception and exits if it is not caught
+static void throw_value(value_t exception, int line, const char* message);
+//converts the error from error_trap into an exception
+static void throw_error(int kind);
+
+//verified code cannot overflow or underflow the stack, so interpret_loop() drops the guards
+#define PUSH(data) do{ \
+        value_t pushed = (data); \
+        if(checked) \
+            stack_push(pushed); \
+        else \
+            *vm.sp++ = pushed; \
+    } while(0)
+#define POP() (checked ? stack_pop() : *--vm.sp)
 
 //pops two values from the stack and pushes the result
 #define CALC_NUMERICAL_OP(return_type, op) do{ \
-        value_t b = stack_pop(); \
-        value_t a = stack_pop(); \
+        value_t b = POP(); \
+        value_t a = POP(); \
         if(!IS_NUMBER(a) || !IS_NUMBER(b)) \
             interpret_error_printf(get_vm_codeline(), "Incompatible type for operation. All operands must be numbers!\n");\
-        stack_push(return_type(AS_NUMBER(a) op AS_NUMBER(b))); \
+        PUSH(return_type(AS_NUMBER(a) op AS_NUMBER(b))); \
     } while(0)
 
 #define CALC_BOOLEAN_OP(op) do{ \
-        value_t b = stack_pop(); \
-        value_t a = stack_pop(); \
+        value_t b = POP(); \
+        value_t a = POP(); \
         if(!IS_BOOLEAN(a) || !IS_BOOLEAN(b)) \
             interpret_error_printf(get_vm_codeline(), "Incompatible type for operation. All operands must be booleans!\n");\
-        stack_push(VALUE_BOOLEAN(AS_BOOLEAN(a) op AS_BOOLEAN(b))); \
+        PUSH(VALUE_BOOLEAN(AS_BOOLEAN(a) op AS_BOOLEAN(b))); \
     } while(0)
 
 #define CALC_VAL_OP(return_type, op)
 
-void vm_interpret(){
+//operands are proven to be numbers at compile time
+#define CALC_NUM_OP(return_type, op) do{ \
+        value_t b = POP(); \
+        value_t a = POP(); \
+        PUSH(return_type(AS_NUMBER(a) op AS_NUMBER(b))); \
+    } while(0)
+
+void vm_interpret(const char* cache_path, uint64_t source_hash, bool is_lazy, const char* profile_path, bool is_profiling){
     vm_init();
 
     struct bytecode_chunk chunk;
     bcchunk_init(&chunk);
+    //compiler may evaluate pure functions
+    vm.code = &chunk;
+    vm.is_profiling = is_profiling;
+    //the profiled run compiles the code without the feedback of the previous one
+    profile_load(is_profiling ? NULL : profile_path);
 
-    while(parse_command(&chunk));
+    //the whole program is cached, so bodies are not skipped
+    is_lazy = is_lazy && cache_path == NULL;
+    parser_set_lazy(is_lazy);
+    if(is_lazy){
+        while(parse_command(&chunk));
+        profile_set_calls();
+    //the cached chunk is already stripped
+    }else if(cache_path == NULL || !bccache_load(&chunk, cache_path, source_hash)){
+        while(parse_command(&chunk));
+        //calls evaluated by the compiler are not counted
+        profile_set_calls();
+        int removed = bcchunk_strip(&chunk, find_entry());
+        dprintf("Removed %d bytes of unreachable code\n", removed);
+        (void)removed;
+        //globals are saved with their initial values, so it is done before the execution
+        if(cache_path != NULL)
+            bccache_save(&chunk, cache_path, source_hash);
+    }
 
-    vm_execute(&chunk);
+    vm_execute(&chunk, is_lazy);
+    //offsets of the recorded sites are valid only in this chunk
+    if(is_profiling)
+        profile_save(profile_path, &chunk);
     bcchunk_free(&chunk);
 
     vm_free();
@@ -82,35 +182,161 @@ static void vm_init(){
     vm.code = NULL;
     vm.ip = NULL;
     vm.bp = vm.sp = VM_STACK_START;
+    vm.steps_left = -1;
+    vm.is_verified = false;
+    vm.is_profiling = false;
+    vm.frame_limit = VM_STACK_END;
 }
 
+static void eval_call(obj_function_t* p, int argc, const value_t* argv, value_t* result){
+    vm.steps_left = EVAL_STEPS_LIMIT;
+    for(int i = argc - 1; i >= 0; i--)
+        stack_push(argv[i]);
+    if(p->memo != NULL)
+        memo_begin(p);
+    //negative return offset ends the evaluation
+    stack_push(VALUE_NUMBER(-1));
+    vm.ip = &vm.code->_code.data[p->entry_offset];
+    preamble();
+    interpret();
+    *result = stack_pop();
+}
 
-static vm_execute_result vm_execute(struct bytecode_chunk* code){
-    vm.code = code;
-#ifdef DEBUG
-    stringtable_debug();
-    symtable_debug();
-    bcchunk_disassemble("Current bytecode", vm.code);
-    
-#endif
+static void eval_native(obj_natfunction_t* p, int argc, const value_t* argv, value_t* result){
+    //errors are trapped, ip only has to point into the chunk for get_vm_codeline()
+    vm.ip = vm.code->_code.data + 1;
+    for(int i = argc - 1; i >= 0; i--)
+        stack_push(argv[i]);
+    *result = p->impl(argc, vm.sp - argc);
+}
 
+bool vm_eval_native(obj_natfunction_t* p, int argc, const value_t* argv, value_t* result){
+    if(vm.code == NULL)
+        return false;
+    byte_t* ip = vm.ip;
+    value_t* sp = vm.sp;
+    jmp_buf* prev_trap = error_trap;
+    jmp_buf trap;
+    volatile bool is_ok = false;
+
+    error_trap = &trap;
+    if(setjmp(trap) == 0){
+        eval_native(p, argc, argv, result);
+        is_ok = true;
+    }
+    error_trap = prev_trap;
+    vm.ip = ip;
+    vm.sp = sp;
+    return is_ok;
+}
+
+bool vm_eval_call(obj_function_t* p, int argc, const value_t* argv, value_t* result){
+    if(p->entry_offset < 0 || vm.code == NULL)
+        return false;
+    byte_t* ip = vm.ip;
+    value_t* sp = vm.sp;
+    value_t* bp = vm.bp;
+    jmp_buf* prev_trap = error_trap;
+    jmp_buf trap;
+    volatile bool is_ok = false;
+
+    error_trap = &trap;
+    switch(setjmp(trap)){
+        case 0:
+            eval_call(p, argc, argv, result);
+            is_ok = true;
+            break;
+        case ERROR_RUNTIME:
+            //a handler in the evaluated code catches the error like at run time,
+            //an error that leaves the evaluated frames and the exceeded steps limit fail the evaluation
+            if(vm.bp != bp && vm.steps_left >= 0){
+                throw_error(ERROR_RUNTIME);
+                interpret();
+                *result = stack_pop();
+                is_ok = true;
+            }
+            //a function that runs out of steps once is not evaluated at other call sites
+            if(vm.steps_left < 0)
+                p->is_pure = false;
+            break;
+        default:
+            break;
+    }
+    error_trap = prev_trap;
+    is_done = 0;
+    vm.steps_left = -1;
+    vm.ip = ip;
+    vm.sp = sp;
+    vm.bp = bp;
+    //a failed evaluation leaves its pending memo calls
+    memo_drop(sp);
+    return is_ok;
+}
+
+
+static obj_function_t* find_entry(){
     const char* entry = ENTRY_FUNCTION_NAME;
     obj_id_t* ptr = symtable_findstr(entry, strlen(entry), hash_string(entry, strlen(entry)));
     value_t func;
     if(ptr == NULL || !symtable_get(ptr,&func) || !IS_OBJFUNCTION(func))
         user_error_printf("Failed to find '%s' entry function\n", entry);
+    compile_lazy(AS_OBJFUNCTION(func));
     if(AS_OBJFUNCTION(func)->entry_offset < 0)
         user_error_printf("Function '%s' is declared but not defined\n", entry);
     if(AS_OBJFUNCTION(func)->base.argc != 0)
         user_error_printf("Function '%s' must not have any arguments\n", entry);
-    vm.ip = &vm.code->_code.data[AS_OBJFUNCTION(func)->entry_offset];
+    return AS_OBJFUNCTION(func);
+}
+
+static vm_execute_result vm_execute(struct bytecode_chunk* code, bool is_lazy){
+    vm.code = code;
+#ifdef DEBUG
+    stringtable_debug();
+    symtable_debug();
+    bcchunk_disassemble("Current bytecode", vm.code);
+#endif
+    obj_function_t* entry = find_entry();
+    vm.ip = &vm.code->_code.data[entry->entry_offset];
 
-    return interpret();
+    //a frame needs the return address, the old bp and its maximal depth
+    //code that is compiled later is not verified, so the checked loop runs it
+    int max_depth = is_lazy ? -1 : bcchunk_verify(vm.code, entry);
+    if(max_depth >= 0 && max_depth + 2 < STACK_SIZE){
+        vm.frame_limit = VM_STACK_END - max_depth - 2;
+#ifndef DEBUG
+        //classes at sites are recorded only by the checked loop
+        vm.is_verified = !vm.is_profiling;
+#endif
+    }
+
+    //runtime errors jump here and the execution continues from the catch block
+    jmp_buf trap;
+    error_trap = &trap;
+    switch(setjmp(trap)){
+        case 0: break;
+        case ERROR_FATAL: throw_error(ERROR_FATAL); break;
+        default: throw_error(ERROR_RUNTIME); break;
+    }
+    vm_execute_result res = interpret();
+    error_trap = NULL;
+    return res;
 }
 
 static void vm_free(){}
 
 static vm_execute_result interpret(){
+    return vm.is_verified ? interpret_unchecked() : interpret_checked();
+}
+
+static vm_execute_result interpret_checked(){
+    return interpret_loop(true);
+}
+
+static vm_execute_result interpret_unchecked(){
+    return interpret_loop(false);
+}
+
+static inline __attribute__((always_inline)) vm_execute_result interpret_loop(const bool checked){
     value_t val;
     while (!is_done) {
         byte_t instruction = read_byte();
@@ -121,15 +347,24 @@ static vm_execute_result interpret(){
 #endif
         dprintf("          BP = 0x%lX SP = 0x%lX\n===#\n", vm.bp - vm.stack, vm.sp - vm.stack);
         switch (instruction) {
+            case OP_MEMO_RETURN:{
+                obj_function_t* p = (obj_function_t*)extract_value(read_constant()).obj;
+                if(vm.bp != &vm.stack[0])
+                    memo_end(p, vm.sp[-1]);
+            }
+            //fall through
             case OP_RETURN:{
                 if(vm.bp == &vm.stack[0])
                     is_done = 1;
                 else{
-                    value_t ret_val = stack_pop();
+                    value_t ret_val = POP();
                     epilogue();
-                    value_t ret_ip = stack_pop();
-                    vm.ip = &vm.code->_code.data[(int)AS_NUMBER(ret_ip)];
-                    stack_push(ret_val);
+                    value_t ret_ip = POP();
+                    PUSH(ret_val);
+                    if(AS_NUMBER(ret_ip) < 0)
+                        is_done = 1;
+                    else
+                        vm.ip = &vm.code->_code.data[(int)AS_NUMBER(ret_ip)];
                 }
                 break;
             }
@@ -150,74 +385,92 @@ static vm_execute_result interpret(){
 #endif
                 break;
             case OP_CLARGS:{
-                value_t temp = stack_pop();
+                value_t temp = POP();
                 vm.sp -= read_constant();
-                stack_push(temp);
+                PUSH(temp);
+                break;
+            }
+            case OP_POPN_SHORT:
+                vm.sp -= read_byte();
+#ifdef DEBUG
+            if(vm.stack > vm.sp)
+                fatal_printf("Stack smashed! Check OP_POPN_SHORT instruction.\n");
+            examine_stack();
+#endif
+                break;
+            case OP_CLARGS_SHORT:{
+                value_t temp = POP();
+                vm.sp -= read_byte();
+                PUSH(temp);
                 break;
             }
             case OP_NUMBER:
-                stack_push(VALUE_NUMBER(extract_value(read_constant()).number));
+                PUSH(VALUE_NUMBER(extract_value(read_constant()).number));
                 break;
             case OP_BOOLEAN:
-                stack_push(VALUE_BOOLEAN(extract_value(read_constant()).boolean));
+                PUSH(VALUE_BOOLEAN(extract_value(read_constant()).boolean));
                 break;
             case OP_STRING:
-                stack_push(VALUE_OBJ(extract_value(read_constant()).obj));
+                PUSH(VALUE_OBJ(extract_value(read_constant()).obj));
                 break;
             case OP_NONE:
-                stack_push(VALUE_NONE);
+                PUSH(VALUE_NONE);
                 break;
             case OP_GET_GLOBAL:{
                 obj_string_t* id = (obj_string_t*)(extract_value(read_constant()).obj);
                 val = get_variable_value(id);
-                stack_push(val);
+                PUSH(val);
                 break;
             }
             case OP_SET_GLOBAL:{
                 obj_string_t* id = (obj_string_t*)(extract_value(read_constant()).obj);
-                value_t expr = stack_pop();
+                value_t expr = POP();
                 set_variable_value(id, expr);
-                stack_push(expr);
+                PUSH(expr);
                 break;
             }
             case OP_GET_LOCAL:{
                 int idx = extract_value(read_constant()).number;
-                stack_push(vm.bp[idx]);
+                PUSH(vm.bp[idx]);
                 break;
             }
             case OP_SET_LOCAL:{
                 int idx = extract_value(read_constant()).number;
-                value_t val = stack_pop();
+                value_t val = POP();
                 //if(!is_value_same_type(val, vm.bp[idx]))
                 //    interpret_error_printf(get_vm_codeline(), "Incorrect assignment type\n");
                 vm.bp[idx] = val;
-                stack_push(vm.bp[idx]);
+                PUSH(vm.bp[idx]);
+                break;
+            }
+            case OP_GET_LOCAL_0: case OP_GET_LOCAL_1: case OP_GET_LOCAL_2: case OP_GET_LOCAL_3:
+                PUSH(vm.bp[instruction - OP_GET_LOCAL_0]);
+                break;
+            case OP_GET_LOCAL_SHORT:{
+                int idx = (int8_t)read_byte();
+                PUSH(vm.bp[idx]);
+                break;
+            }
+            case OP_SET_LOCAL_SHORT:{
+                int idx = (int8_t)read_byte();
+                value_t val = POP();
+                vm.bp[idx] = val;
+                PUSH(val);
                 break;
             }
             case OP_ADD:{
-                value_t b = stack_pop();
-                value_t a = stack_pop();
-                if(IS_NUMBER(a) && IS_NUMBER(b)){
-                    stack_push(VALUE_NUMBER(AS_NUMBER(a) + AS_NUMBER(b)));
-                }else if(IS_OBJSTRING(a) && IS_OBJSTRING(b)){
-                    stack_push(VALUE_OBJ(objstring_conc(a,b)));
-                }else{
-                    interpret_error_printf(get_vm_codeline(), "Incompatible types for operation.\n");\
-                }
+                value_t b = POP();
+                value_t a = POP();
+                PUSH(perform_arith(OP_ADD, a, b));
             }
                 break;
             case OP_SUB: 
                 CALC_NUMERICAL_OP(VALUE_NUMBER,-);
                 break;
             case OP_DIV: {
-                value_t b = stack_pop();
-                value_t a = stack_pop();
-                if(!IS_NUMBER(a) || !IS_NUMBER(b)) 
-                    interpret_error_printf(get_vm_codeline(),
-                     "Incompatible type for operation. All operands must be numbers!\n");
-                     if(AS_NUMBER(b) == 0)
-                        interpret_error_printf(get_vm_codeline(), "Division by zero\n");
-                stack_push(VALUE_NUMBER(AS_NUMBER(a) / AS_NUMBER(b))); 
+                value_t b = POP();
+                value_t a = POP();
+                PUSH(perform_arith(OP_DIV, a, b));
                 break;
             }
             case OP_MUL: 
@@ -233,61 +486,141 @@ static vm_execute_result interpret(){
                 CALC_BOOLEAN_OP(^);
                 break;
             case OP_NOT:
-                stack_push(VALUE_BOOLEAN(!AS_BOOLEAN(stack_pop())));
+                PUSH(VALUE_BOOLEAN(!AS_BOOLEAN(POP())));
                 break;
             case OP_EQUAL:{
-                value_t b = stack_pop();
-                value_t a = stack_pop();
+                value_t b = POP();
+                value_t a = POP();
                 if(IS_NUMBER(a) && IS_NUMBER(b)){
-                    stack_push(VALUE_BOOLEAN(AS_NUMBER(a) == AS_NUMBER(b)));
+                    PUSH(VALUE_BOOLEAN(AS_NUMBER(a) == AS_NUMBER(b)));
                 }else if(IS_BOOLEAN(a) && IS_BOOLEAN(b)){
-                    stack_push(VALUE_BOOLEAN(AS_BOOLEAN(a) == AS_BOOLEAN(b)));
+                    PUSH(VALUE_BOOLEAN(AS_BOOLEAN(a) == AS_BOOLEAN(b)));
                 }else if(IS_OBJSTRING(a) && IS_OBJSTRING(b)){
-                    stack_push(VALUE_BOOLEAN(AS_OBJSTRING(a) == AS_OBJSTRING(b)));
+                    PUSH(VALUE_BOOLEAN(AS_OBJSTRING(a) == AS_OBJSTRING(b)));
                 }else{
                     interpret_error_printf(get_vm_codeline(), "Incompatible types for operation!\n");
                 }
                 break;
             }
             case OP_GREATER:{
-                value_t b = stack_pop();
-                value_t a = stack_pop();
+                value_t b = POP();
+                value_t a = POP();
                 if(IS_NUMBER(a) && IS_NUMBER(b)){
-                    stack_push(VALUE_BOOLEAN(AS_NUMBER(a) > AS_NUMBER(b)));
+                    PUSH(VALUE_BOOLEAN(AS_NUMBER(a) > AS_NUMBER(b)));
                 }else if(IS_BOOLEAN(a) && IS_BOOLEAN(b)){
-                    stack_push(VALUE_BOOLEAN(AS_BOOLEAN(a) > AS_BOOLEAN(b)));
+                    PUSH(VALUE_BOOLEAN(AS_BOOLEAN(a) > AS_BOOLEAN(b)));
                 }else if(IS_OBJSTRING(a) && IS_OBJSTRING(b)){
-                    stack_push(VALUE_BOOLEAN(strcmp(AS_OBJSTRING(a)->str, AS_OBJSTRING(b)->str) > 0));
+                    PUSH(VALUE_BOOLEAN(strcmp(AS_OBJSTRING(a)->str, AS_OBJSTRING(b)->str) > 0));
                 }else{
                     interpret_error_printf(get_vm_codeline(), "Incompatible types for operation!\n");
                 }
                 break;
             }
             case OP_LESS:{
-                value_t b = stack_pop();
-                value_t a = stack_pop();
+                value_t b = POP();
+                value_t a = POP();
                 if(IS_NUMBER(a) && IS_NUMBER(b)){
-                    stack_push(VALUE_BOOLEAN(AS_NUMBER(a) < AS_NUMBER(b)));
+                    PUSH(VALUE_BOOLEAN(AS_NUMBER(a) < AS_NUMBER(b)));
                 }else if(IS_BOOLEAN(a) && IS_BOOLEAN(b)){
-                    stack_push(VALUE_BOOLEAN(AS_BOOLEAN(a) < AS_BOOLEAN(b)));
+                    PUSH(VALUE_BOOLEAN(AS_BOOLEAN(a) < AS_BOOLEAN(b)));
                 }else if(IS_OBJSTRING(a) && IS_OBJSTRING(b)){
-                    stack_push(VALUE_BOOLEAN(strcmp(AS_OBJSTRING(a)->str, AS_OBJSTRING(b)->str) < 0));
+                    PUSH(VALUE_BOOLEAN(strcmp(AS_OBJSTRING(a)->str, AS_OBJSTRING(b)->str) < 0));
                 }else{
                     interpret_error_printf(get_vm_codeline(), "Incompatible types for operation!\n");
                 }
                 break;
             }
             case OP_JUMP:{
-                vm.ip += read_constant();
+                int jump = read_constant();
+                if(jump < 0)
+                    count_step();
+                vm.ip += jump;
                 break;
             }
             case OP_FJUMP:{
-                val = stack_pop();
+                val = POP();
+                int jump = read_constant();
+                if(!IS_BOOLEAN(val))
+                    interpret_error_printf(get_vm_codeline(), "Expected logical expression\n");
+                if(!AS_BOOLEAN(val)){
+                    if(jump < 0)
+                        count_step();
+                    vm.ip += jump;
+                }
+                break;
+            }
+            case OP_TJUMP:{
+                val = POP();
                 int jump = read_constant();
                 if(!IS_BOOLEAN(val))
                     interpret_error_printf(get_vm_codeline(), "Expected logical expression\n");
-                if(!AS_BOOLEAN(val))
+                if(AS_BOOLEAN(val)){
+                    if(jump < 0)
+                        count_step();
                     vm.ip += jump;
+                }
+                break;
+            }
+
+            #define FOR_LOOP(step_op, cmp_op) do{\
+                value_t* counter = &vm.bp[read_constant()];\
+                value_t limit = vm.bp[read_constant()];\
+                int jump = read_constant();\
+                if(!IS_NUMBER(*counter))\
+                    interpret_error_printf(get_vm_codeline(), "Inapropriate value type for increment/decrement\n");\
+                step_op AS_NUMBER(*counter);\
+                if(!IS_NUMBER(limit))\
+                    interpret_error_printf(get_vm_codeline(), "Incompatible types for operation!\n");\
+                if(AS_NUMBER(*counter) cmp_op AS_NUMBER(limit)){\
+                    count_step();\
+                    vm.ip += jump;\
+                }\
+            }while(0)
+
+            case OP_FORLOOP_LESS:
+                FOR_LOOP(++, <);
+                break;
+            case OP_FORLOOP_ELESS:
+                FOR_LOOP(++, <=);
+                break;
+            case OP_FORLOOP_GREATER:
+                FOR_LOOP(--, >);
+                break;
+            case OP_FORLOOP_EGREATER:
+                FOR_LOOP(--, >=);
+                break;
+
+            #undef FOR_LOOP
+
+            //value that doesn't match any case jumps to default
+            case OP_SWITCH_TABLE:{
+                union _inner_value_t* table = extract_table(read_constant());
+                value_t val = POP();
+                int jump = table[2].number;
+                if(IS_NUMBER(val)){
+                    double idx = AS_NUMBER(val) - table[0].number;
+                    if(idx >= 0 && idx < table[1].number && idx == (int)idx)
+                        jump = table[3 + (int)idx].number;
+                }
+                vm.ip += jump;
+                break;
+            }
+            case OP_SWITCH_HASH:{
+                union _inner_value_t* table = extract_table(read_constant());
+                value_t val = POP();
+                int jump = table[1].number;
+                bool is_string = table[2].number;
+                if(is_string ? IS_OBJSTRING(val) : IS_NUMBER(val)){
+                    uint32_t mask = (uint32_t)table[0].number - 1;
+                    for(uint32_t i = switch_key_hash(val.as, is_string) & mask; table[4 + 2 * i].number >= 0; i = (i + 1) & mask){
+                        union _inner_value_t* key = &table[3 + 2 * i];
+                        if(is_string ? key->obj == AS_OBJ(val) : key->number == AS_NUMBER(val)){
+                            jump = table[4 + 2 * i].number;
+                            break;
+                        }
+                    }
+                }
+                vm.ip += jump;
                 break;
             }
 
@@ -305,14 +638,14 @@ static vm_execute_result interpret(){
                 EXTRACT_GLOBAL(id, val); \
                 op AS_NUMBER(val); \
                 symtable_set(id, val);\
-                stack_push(val);\
+                PUSH(val);\
             }while(0)
 
             #define POST_OP_GLOBAL(op) do{\
                 obj_id_t* id; \
                 value_t val; \
                 EXTRACT_GLOBAL(id, val); \
-                stack_push(val);\
+                PUSH(val);\
                 op AS_NUMBER(val); \
                 symtable_set(id, val);\
             }while(0)
@@ -321,7 +654,7 @@ static vm_execute_result interpret(){
                 int idx = extract_value(read_constant()).number;\
                 if(!IS_NUMBER(vm.bp[idx]))\
                     interpret_error_printf(get_vm_codeline(), "Inapropriate value type for increment/decrement\n");\
-                stack_push(vm.bp[idx]);\
+                PUSH(vm.bp[idx]);\
                 op AS_NUMBER(vm.bp[idx]);\
             }while(0)
 
@@ -330,7 +663,7 @@ static vm_execute_result interpret(){
                 if(!IS_NUMBER(vm.bp[idx]))\
                     interpret_error_printf(get_vm_codeline(), "Inapropriate value type for increment/decrement\n");\
                 op AS_NUMBER(vm.bp[idx]);\
-                stack_push(vm.bp[idx]);\
+                PUSH(vm.bp[idx]);\
             }while(0)
 
             case OP_PREFINCR_GLOBAL:{
@@ -376,70 +709,223 @@ static vm_execute_result interpret(){
                 break;
             }
             case OP_NATIVE_CALL:{
-                int argc = AS_NUMBER(stack_pop());
                 obj_natfunction_t* p = (obj_natfunction_t*)extract_value(read_constant()).obj;
-                stack_push(p->impl(argc, vm.sp - argc));
+                value_t* argv = vm.sp - read_constant();
+                val = p->impl(vm.sp - argv, argv);
+                vm.sp = argv;
+                PUSH(val);
                 break;
             }
             case OP_INSTANCE:{
                 obj_instance_t* new_instance = mk_objinstance((obj_class_t*)extract_value(read_constant()).obj);
                 gc_add((obj_t*)new_instance);
-                stack_push(VALUE_OBJ(new_instance));
+                PUSH(VALUE_OBJ(new_instance));
                 break;
             }
             case OP_SET_FIELD:{
                 value_t inst;
                 extract_instance(&inst,0);
                 vm.sp--;
-                value_t val = stack_pop();
-                obj_id_t* field = (obj_id_t*)extract_value(read_constant()).obj;
-
-                value_t field_val;
-                if(!table_check(AS_OBJINSTANCE(inst)->impl->fields, field, &field_val))
-                    interpret_error_printf(get_vm_codeline(),
-                 "Instance of class '%s' doesn't have field '%s'\n",
-                AS_OBJINSTANCE(inst)->impl->name->str, field->str);
-                int idx = AS_NUMBER(field_val);
-                
-                AS_OBJINSTANCE(inst)->data[idx] = val;
-                stack_push(val);
+                value_t val = POP();
+                *extract_field(inst, (obj_id_t*)extract_value(read_constant()).obj) = val;
+                PUSH(val);
                 break;
             }
             case OP_GET_FIELD:{
                 value_t inst;
-                extract_instance(&inst,0);
+                extract_instance(&inst,0); //reports a value that is not an instance before it is profiled
                 vm.sp--;
+                if(checked && vm.is_profiling)
+                    profile_record_site(vm.ip - vm.code->_code.data - 1, AS_OBJINSTANCE(inst)->impl);
                 obj_id_t* field = (obj_id_t*)extract_value(read_constant()).obj;
+                PUSH(*extract_field(inst, field));
+                break;
+            }
 
-                if(!IS_OBJINSTANCE(inst))
-                    interpret_error_printf(get_vm_codeline(), "Value is not an instance\n");
+            #define TYPE_TEST(is_type) do{\
+                vm.sp[-1] = VALUE_BOOLEAN(is_type(vm.sp[-1]));\
+            }while(0)
+
+            #define MATH_OP(name, argc, expr) do{\
+                for(int i = 1; i <= (argc); i++)\
+                    if(!IS_NUMBER(vm.sp[-i]))\
+                        interpret_error_printf(get_vm_codeline(), "Expected number as argument in '" name "' function call\n");\
+                double a = AS_NUMBER(vm.sp[-1]);\
+                double b = AS_NUMBER(vm.sp[-(argc)]);\
+                (void)b;\
+                vm.sp -= (argc) - 1;\
+                vm.sp[-1] = VALUE_NUMBER(expr);\
+            }while(0)
 
-                value_t field_val;
-                if(!table_check(AS_OBJINSTANCE(inst)->impl->fields, field, &field_val))
-                    interpret_error_printf(get_vm_codeline(),
-                 "Instance of class '%s' doesn't have field '%s'\n",
-                AS_OBJINSTANCE(inst)->impl->name->str, field->str);
-                int idx = AS_NUMBER(field_val);
+            case OP_IS_NUM: TYPE_TEST(IS_NUMBER); break;
+            case OP_IS_STR: TYPE_TEST(IS_OBJSTRING); break;
+            case OP_IS_BOOL: TYPE_TEST(IS_BOOLEAN); break;
+            case OP_IS_INST: TYPE_TEST(IS_OBJINSTANCE); break;
+            case OP_IS_NONE: TYPE_TEST(IS_NONE); break;
+            case OP_IS_UNINIT: TYPE_TEST(IS_UNINIT); break;
+            //the first argument is on the top of the stack
+            case OP_SQRT: MATH_OP("sqrt", 1, sqrt(a)); break;
+            case OP_FLOOR: MATH_OP("floor", 1, floor(a)); break;
+            case OP_ABS: MATH_OP("abs", 1, fabs(a)); break;
+            case OP_MIN: MATH_OP("min", 2, fmin(a, b)); break;
+            case OP_MAX: MATH_OP("max", 2, fmax(a, b)); break;
+            case OP_POW: MATH_OP("pow", 2, pow(a, b)); break;
 
-                stack_push(AS_OBJINSTANCE(inst)->data[idx]);
+            #undef TYPE_TEST
+            #undef MATH_OP
+            case OP_GET_PATH:{
+                union _inner_value_t* table = extract_table(read_constant());
+                value_t val = POP();
+                int count = table[0].number;
+                for(union _inner_value_t* hop = table + 1; hop < table + 1 + 3 * count; hop += 3){
+                    if(!IS_OBJINSTANCE(val))
+                        interpret_error_printf(get_vm_codeline(), "Value is not an instance\n");
+                    obj_instance_t* inst = AS_OBJINSTANCE(val);
+                    //field index is looked up only if the class differs from the cached one
+                    if(hop[1].obj != (obj_t*)inst->impl){
+                        hop[2].number = extract_field(val, (obj_id_t*)hop[0].obj) - inst->data;
+                        hop[1].obj = (obj_t*)inst->impl;
+                    }
+                    val = inst->data[(int)hop[2].number];
+                }
+                PUSH(val);
                 break;
             }
+            case OP_CONCAT_N:{
+                int count = read_constant();
+                bool convert = read_constant();
+                value_t* args = vm.sp - count;
+                bool is_strings = true;
+                for(int i = 0; i < count; i++){
+                    if(convert && !IS_OBJSTRING(args[i])){
+                        obj_string_t* str = value_to_objstring(args[i]);
+                        if(str == NULL)
+                            interpret_error_printf(get_vm_codeline(), "Cannot convert value to string\n");
+                        args[i] = VALUE_OBJ(str);
+                    }
+                    is_strings = is_strings && IS_OBJSTRING(args[i]);
+                }
+                value_t res = args[0];
+                if(is_strings){
+                    res = VALUE_OBJ(objstring_conc_n(args, count));
+                }else{
+                    for(int i = 1; i < count; i++)
+                        res = perform_arith(OP_ADD, res, args[i]);
+                }
+                vm.sp = args;
+                PUSH(res);
+                break;
+            }
+
+            #define ASSIGN_OP_LOCAL(op) do{\
+                int idx = extract_value(read_constant()).number;\
+                value_t b = POP();\
+                vm.bp[idx] = perform_arith(op, vm.bp[idx], b);\
+                PUSH(vm.bp[idx]);\
+            }while(0)
+
+            #define ASSIGN_OP_GLOBAL(op) do{\
+                obj_id_t* id = (obj_id_t*)extract_value(read_constant()).obj;\
+                value_t val;\
+                if(!symtable_get(id, &val) || IS_NONE(val))\
+                    interpret_error_printf(get_vm_codeline(), "Undefined identifier '%s'\n", id->str);\
+                val = perform_arith(op, val, POP());\
+                symtable_set(id, val);\
+                PUSH(val);\
+            }while(0)
+
+            #define ASSIGN_OP_FIELD(op) do{\
+                value_t inst;\
+                extract_instance(&inst, 0);\
+                vm.sp--;\
+                value_t b = POP();\
+                value_t* field = extract_field(inst, (obj_id_t*)extract_value(read_constant()).obj);\
+                *field = perform_arith(op, *field, b);\
+                PUSH(*field);\
+            }while(0)
+
+            case OP_ADD_ASSIGN_LOCAL: ASSIGN_OP_LOCAL(OP_ADD); break;
+            case OP_SUB_ASSIGN_LOCAL: ASSIGN_OP_LOCAL(OP_SUB); break;
+            case OP_MUL_ASSIGN_LOCAL: ASSIGN_OP_LOCAL(OP_MUL); break;
+            case OP_DIV_ASSIGN_LOCAL: ASSIGN_OP_LOCAL(OP_DIV); break;
+            case OP_ADD_ASSIGN_GLOBAL: ASSIGN_OP_GLOBAL(OP_ADD); break;
+            case OP_SUB_ASSIGN_GLOBAL: ASSIGN_OP_GLOBAL(OP_SUB); break;
+            case OP_MUL_ASSIGN_GLOBAL: ASSIGN_OP_GLOBAL(OP_MUL); break;
+            case OP_DIV_ASSIGN_GLOBAL: ASSIGN_OP_GLOBAL(OP_DIV); break;
+            case OP_ADD_ASSIGN_FIELD: ASSIGN_OP_FIELD(OP_ADD); break;
+            case OP_SUB_ASSIGN_FIELD: ASSIGN_OP_FIELD(OP_SUB); break;
+            case OP_MUL_ASSIGN_FIELD: ASSIGN_OP_FIELD(OP_MUL); break;
+            case OP_DIV_ASSIGN_FIELD: ASSIGN_OP_FIELD(OP_DIV); break;
+
+            #undef ASSIGN_OP_LOCAL
+            #undef ASSIGN_OP_GLOBAL
+            #undef ASSIGN_OP_FIELD
             case OP_METHOD:{
-                int argc = AS_NUMBER(stack_pop());
+                int argc = AS_NUMBER(POP());
                 value_t inst;
                 extract_instance(&inst, argc);
+                if(checked && vm.is_profiling)
+                    profile_record_site(vm.ip - vm.code->_code.data - 1, AS_OBJINSTANCE(inst)->impl);
                 obj_id_t* meth = (obj_id_t*)extract_value(read_constant()).obj;
-                value_t val;
-                if(!table_check(AS_OBJINSTANCE(inst)->impl->methods, meth,&val))
-                    interpret_error_printf(get_vm_codeline(), "Instance of class '%s' doesn't have method '%s'\n", 
-                AS_OBJINSTANCE(inst)->impl->name->str, meth->str);
-                if(AS_OBJFUNCTION(val)->base.argc != argc)
-                    interpret_error_printf(get_vm_codeline(), "Expected %d arguments, found %d in '%s' method\n",
-                 AS_OBJFUNCTION(val)->base.argc, argc, AS_OBJFUNCTION(val)->base.name->str);
-                perform_call(AS_OBJFUNCTION(val));
+                perform_call(find_method(inst, meth, argc));
+                break;
+            }
+            case OP_INVOKE:{
+                obj_class_t* cl = (obj_class_t*)extract_value(read_constant()).obj;
+                obj_function_t* p = (obj_function_t*)extract_value(read_constant()).obj;
+                value_t inst = vm.sp[-p->base.argc - 1];
+                if(!IS_OBJINSTANCE(inst) || AS_OBJINSTANCE(inst)->impl != cl){
+                    extract_instance(&inst, p->base.argc);
+                    p = find_method(inst, p->base.name, p->base.argc);
+                }
+                perform_call(p);
+                break;
+            }
+            case OP_ADD_NUM:
+                CALC_NUM_OP(VALUE_NUMBER, +);
+                break;
+            case OP_SUB_NUM:
+                CALC_NUM_OP(VALUE_NUMBER, -);
+                break;
+            case OP_MUL_NUM:
+                CALC_NUM_OP(VALUE_NUMBER, *);
+                break;
+            case OP_DIV_NUM:
+                if(AS_NUMBER(vm.sp[-1]) == 0)
+                    interpret_error_printf(get_vm_codeline(), "Division by zero\n");
+                CALC_NUM_OP(VALUE_NUMBER, /);
+                break;
+            case OP_EQUAL_NUM:
+                CALC_NUM_OP(VALUE_BOOLEAN, ==);
+                break;
+            case OP_GREATER_NUM:
+                CALC_NUM_OP(VALUE_BOOLEAN, >);
+                break;
+            case OP_LESS_NUM:
+                CALC_NUM_OP(VALUE_BOOLEAN, <);
+                break;
+            case OP_CHECK_TYPE:{
+                static_type type = read_constant();
+                if(!is_value_static_type(vm.sp[-1], type))
+                    interpret_error_printf(get_vm_codeline(), "Expected value of type '%s'\n", get_static_type_name(type));
+                break;
+            }
+            case OP_THROW:
+                val = POP();
+                throw_value(val, get_vm_codeline(), NULL);
+                break;
+            case OP_CHECK_ARGS:{
+                obj_function_t* p = (obj_function_t*)extract_value(read_constant()).obj;
+                for(int i = 0; i < p->base.argc; i++)
+                    if(!is_value_static_type(vm.bp[-i - 3], p->arg_types[i]))
+                        interpret_error_printf(get_caller_codeline(), "Expected value of type '%s' as argument %d in '%s' call\n",
+                    get_static_type_name(p->arg_types[i]), i + 1, p->base.name->str);
                 break;
             }
             default: 
+                //verified code contains only known instructions
+                if(!checked)
+                    __builtin_unreachable();
                 eprintf("Undefined instruction!\n");
                 return VME_RUNTIME_ERROR;
         }
@@ -461,6 +947,10 @@ static inline union _inner_value_t extract_value(int offset){
     return *(union _inner_value_t*)(vm.code->_data.data + offset);
 }
 
+static inline union _inner_value_t* extract_table(int offset){
+    return (union _inner_value_t*)(vm.code->_data.data + offset);
+}
+
 static inline void stack_push(value_t data){
     if(vm.sp < VM_STACK_END)
         *vm.sp++ = data;
@@ -487,7 +977,14 @@ static inline value_t stack_pop(){
 int get_vm_codeline(){
     //ip is always incremented
     //so it looks at the next instruction so we need -1
-    return ((int*)vm.code->_line_data.data)[vm.ip - vm.code->_code.data - 1];
+    return bcchunk_get_line(vm.code, vm.ip - vm.code->_code.data - 1);
+}
+
+static int get_caller_codeline(){
+    //the return address is below the old bp and points after the call instruction
+    if(vm.bp == &vm.stack[0] || !IS_NUMBER(vm.bp[-2]) || AS_NUMBER(vm.bp[-2]) < 0)
+        return get_vm_codeline();
+    return bcchunk_get_line(vm.code, (int)AS_NUMBER(vm.bp[-2]) - 1);
 }
 
 static value_t get_variable_value(obj_id_t* id){
@@ -531,20 +1028,173 @@ static void epilogue(){
     vm.bp = &vm.stack[(int)AS_NUMBER(val)];
 }
 
+static void memo_begin(const obj_function_t* p){
+    int key = memo_calls_count > 0 ? memo_calls[memo_calls_count - 1].key + memo_calls[memo_calls_count - 1].argc : 0;
+    const value_t* args = vm.sp - p->base.argc;
+    memo_drop(args);
+    if(memo_calls_count == STACK_SIZE || key + p->base.argc > STACK_SIZE)
+        return;
+    memcpy(memo_keys + key, args, sizeof(value_t) * p->base.argc);
+    memo_calls[memo_calls_count++] = (struct memo_call){.args = args, .key = key, .argc = p->base.argc};
+}
+
+static void memo_end(obj_function_t* p, value_t result){
+    //arguments are below the return address and the old bp
+    const value_t* args = vm.bp - 2 - p->base.argc;
+    memo_drop(args + 1);
+    if(memo_calls_count == 0 || memo_calls[memo_calls_count - 1].args != args)
+        return;
+    memo_store(p->memo, memo_keys + memo_calls[--memo_calls_count].key, result);
+}
+
+static void memo_drop(const value_t* limit){
+    while(memo_calls_count > 0 && memo_calls[memo_calls_count - 1].args >= limit)
+        memo_calls_count--;
+}
+
+static void throw_value(value_t exception, int line, const char* message){
+    int offset = vm.ip - vm.code->_code.data - 1;
+    for(;;){
+        const struct exception_handler* handler = bcchunk_find_handler(vm.code, offset);
+        if(handler != NULL){
+            vm.sp = vm.bp + handler->depth;
+            memo_drop(vm.sp);
+            stack_push(exception);
+            vm.ip = &vm.code->_code.data[handler->target];
+            return;
+        }
+        //the entry function, the error is reported instead of jumping to the trap again
+        if(vm.bp == &vm.stack[0]){
+            error_trap = NULL;
+            break;
+        }
+        epilogue();
+        value_t ret_ip = stack_pop();
+        //the compile time evaluation fails
+        if(AS_NUMBER(ret_ip) < 0)
+            break;
+        //the return address is after the call instruction
+        offset = (int)AS_NUMBER(ret_ip) - 1;
+    }
+    if(message != NULL)
+        interpret_error_printf(line, "%s", message);
+    obj_string_t* str = value_to_objstring(exception);
+    if(str != NULL)
+        interpret_error_printf(line, "Uncaught exception: %s\n", str->str);
+    if(IS_OBJINSTANCE(exception))
+        interpret_error_printf(line, "Uncaught exception: instance of class %s\n", AS_OBJINSTANCE(exception)->impl->name->str);
+    interpret_error_printf(line, "Uncaught exception\n");
+}
+
+static void throw_error(int kind){
+    if(kind == ERROR_FATAL){
+        error_trap = NULL;
+        fatal_printf("%s", error_message);
+    }
+    //the exception is the message without the newline
+    size_t len = strlen(error_message);
+    while(len > 0 && error_message[len - 1] == '\n')
+        len--;
+    value_t exception = VALUE_OBJ(stringtable_findstr(error_message, len, hash_string(error_message, len)));
+    throw_value(exception, error_line, error_message);
+}
+
+static bool compile_lazy(obj_function_t* p){
+    if(p->source_offset < 0)
+        return false;
+    ptrdiff_t ip = vm.ip != NULL ? vm.ip - vm.code->_code.data : 0;
+    parse_lazy_function(vm.code, p);
+    dprintf("Compiled '%s' on the first call\n", p->base.name->str);
+    if(vm.ip != NULL)
+        vm.ip = vm.code->_code.data + ip;
+    return true;
+}
+
+void vm_compile_for_eval(obj_function_t* p){
+    int start = vm.code->_code.size;
+    if(!compile_lazy(p))
+        return;
+    int end = vm.code->_code.size;
+    bool has_callees = false;
+    for(int offset = start; offset < end; offset += bcchunk_instruction_size(vm.code->_code.data[offset]))
+        if(vm.code->_code.data[offset] == OP_CALL){
+            obj_function_t* callee = (obj_function_t*)extract_value(*(int*)(vm.code->_code.data + offset + 1)).obj;
+            if(callee->source_offset >= 0){
+                vm_compile_for_eval(callee);
+                has_callees = true;
+            }
+        }
+    //the callees were not compiled when the body was checked
+    if(has_callees)
+        p->is_pure = bcchunk_is_pure(vm.code, p->entry_offset, p);
+}
+
 static void perform_call(obj_function_t* p){
+    if(p->entry_offset < 0)
+        compile_lazy(p);
     if(p->entry_offset < 0)
         interpret_error_printf(get_vm_codeline(), "Function '%s' is declared but not defined\n", p->base.name->str);
+    value_t result;
+    //the cached result replaces the call, arguments are cleared by the caller
+    if(p->memo != NULL && memo_lookup(p->memo, vm.sp - p->base.argc, &result)){
+        stack_push(result);
+        return;
+    }
+    if(p->memo != NULL)
+        memo_begin(p);
+    p->calls++;
+    count_step();
+    //the verified loop does not check pushes, so the whole frame must fit
+    if(vm.sp > vm.frame_limit)
+        fatal_printf("Stack overflow!\n");
     stack_push(VALUE_NUMBER(vm.ip - vm.code->_code.data));
     vm.ip = &vm.code->_code.data[p->entry_offset];
     preamble();
 }
 
+static obj_function_t* find_method(value_t inst, obj_id_t* meth, int argc){
+    value_t val;
+    if(!table_check(AS_OBJINSTANCE(inst)->impl->methods, meth,&val))
+        interpret_error_printf(get_vm_codeline(), "Instance of class '%s' doesn't have method '%s'\n", 
+    AS_OBJINSTANCE(inst)->impl->name->str, meth->str);
+    if(AS_OBJFUNCTION(val)->base.argc != argc)
+        interpret_error_printf(get_vm_codeline(), "Expected %d arguments, found %d in '%s' method\n",
+     AS_OBJFUNCTION(val)->base.argc, argc, AS_OBJFUNCTION(val)->base.name->str);
+    return AS_OBJFUNCTION(val);
+}
+
 static void extract_instance(value_t* val, int argc){
     *val = vm.sp[-argc - 1];
     if(!IS_OBJINSTANCE(*val))
         interpret_error_printf(get_vm_codeline(), "Value is not an instance\n");
 }
 
+static value_t* extract_field(value_t inst, obj_id_t* field){
+    value_t field_val;
+    if(!table_check(AS_OBJINSTANCE(inst)->impl->fields, field, &field_val))
+        interpret_error_printf(get_vm_codeline(),
+        "Instance of class '%s' doesn't have field '%s'\n",
+        AS_OBJINSTANCE(inst)->impl->name->str, field->str);
+    return &AS_OBJINSTANCE(inst)->data[(int)AS_NUMBER(field_val)];
+}
+
+static value_t perform_arith(op_t op, value_t a, value_t b){
+    if(op == OP_ADD && IS_OBJSTRING(a) && IS_OBJSTRING(b))
+        return VALUE_OBJ(objstring_conc(a,b));
+    if(!IS_NUMBER(a) || !IS_NUMBER(b))
+        interpret_error_printf(get_vm_codeline(), op == OP_ADD ? "Incompatible types for operation.\n" :
+        "Incompatible type for operation. All operands must be numbers!\n");
+    switch(op){
+        case OP_ADD: return VALUE_NUMBER(AS_NUMBER(a) + AS_NUMBER(b));
+        case OP_SUB: return VALUE_NUMBER(AS_NUMBER(a) - AS_NUMBER(b));
+        case OP_MUL: return VALUE_NUMBER(AS_NUMBER(a) * AS_NUMBER(b));
+        default:
+            if(AS_NUMBER(b) == 0)
+                interpret_error_printf(get_vm_codeline(), "Division by zero\n");
+            return VALUE_NUMBER(AS_NUMBER(a) / AS_NUMBER(b));
+    }
+}
+
 #ifdef DEBUG
 static void examine_stack(){
     printf("\t=== Stack ===\n");
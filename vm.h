@@ -1,6 +1,7 @@
 #ifndef VM_H
 #define VM_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include "bytecode.h"
@@ -13,6 +14,10 @@ struct virtual_machine{
     value_t stack[STACK_SIZE];
     value_t* sp;
     value_t* bp;
+    int steps_left; //-1 if execution is not limited
+    bool is_verified; //the code is proven by the verifier and runs without the stack guards
+    bool is_profiling; //classes of receivers at method calls and field reads are recorded
+    value_t* frame_limit; //a call fails if sp is above it
 };
 
 typedef enum{
@@ -21,7 +26,19 @@ typedef enum{
     VME_COMPILE_ERROR
 } vm_execute_result;
 
-void vm_interpret();
+//if cache_path is set, the compiled chunk is loaded from it or saved there for the next run
+//if is_lazy is set and there is no cache, bodies of functions are compiled on the first call
+//the profile at profile_path places hot functions first and caches classes at method calls and field reads
+//if is_profiling is set, the profile is not read, but recorded during the run and saved there
+void vm_interpret(const char* cache_path, uint64_t source_hash, bool is_lazy, const char* profile_path, bool is_profiling);
+//evaluates the call at compile time, argv contains arguments in order
+//returns false if evaluation failed or ran out of steps, in the latter case the function is no longer pure
+bool vm_eval_call(obj_function_t* p, int argc, const value_t* argv, value_t* result);
+//compiles the function skipped by the lazy parser and the functions it calls,
+//so a global initializer may evaluate the call, the code must be between functions
+void vm_compile_for_eval(obj_function_t* p);
+//evaluates a native function at compile time, false if it reports an error
+bool vm_eval_native(obj_natfunction_t* p, int argc, const value_t* argv, value_t* result);
 
 int get_vm_codeline();
 #endif
\ No newline at end of file